@@ -0,0 +1,163 @@
+/*
+ * nohz_jitter - measure the interruptions seen by a busy task
+ *
+ * Pins itself to a CPU and spins reading CLOCK_MONOTONIC. Every gap
+ * between two consecutive reads which exceeds the threshold is time
+ * the task did not run: an interrupt, a tick, or another task. On a
+ * CPU booted with nohz_full= the tick should be gone from the results
+ * apart from the residual 1 Hz one.
+ *
+ * usage: nohz_jitter [-c cpu] [-d seconds] [-t threshold_ns]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define NR_BUCKETS	16
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Return the local timer interrupt count ("LOC") of @cpu, or -1 when
+ * /proc/interrupts does not provide it.
+ */
+static long long local_timer_irqs(int cpu)
+{
+	char line[4096];
+	long long ret = -1;
+	FILE *f;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return -1;
+
+	/* Skip the header, the columns are the online cpus in order */
+	if (!fgets(line, sizeof(line), f))
+		goto out;
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p = line;
+		int i;
+
+		while (*p == ' ')
+			p++;
+		if (strncmp(p, "LOC:", 4))
+			continue;
+		p += 4;
+		for (i = 0; i <= cpu; i++)
+			ret = strtoll(p, &p, 10);
+		break;
+	}
+out:
+	fclose(f);
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-c cpu] [-d seconds] [-t threshold_ns]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long hist[NR_BUCKETS] = { 0 };
+	unsigned long long start, end, prev, t, delta;
+	unsigned long long lost = 0, max = 0, hits = 0, loops = 0;
+	unsigned long long threshold = 1000;
+	long long irqs_before, irqs_after;
+	int cpu = 1, duration = 10;
+	cpu_set_t set;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "c:d:t:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 't':
+			threshold = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		perror("mlockall (continuing)");
+
+	irqs_before = local_timer_irqs(cpu);
+
+	start = prev = now_ns();
+	end = start + duration * 1000000000ULL;
+	do {
+		t = now_ns();
+		delta = t - prev;
+		prev = t;
+		loops++;
+
+		if (delta < threshold)
+			continue;
+
+		hits++;
+		lost += delta;
+		if (delta > max)
+			max = delta;
+
+		/* Bucket i holds gaps of [2^i, 2^(i+1)) microseconds */
+		delta /= 1000;
+		for (i = 0; delta > 1 && i < NR_BUCKETS - 1; i++)
+			delta >>= 1;
+		hist[i]++;
+	} while (t < end);
+
+	irqs_after = local_timer_irqs(cpu);
+
+	printf("cpu %d, %d s, threshold %llu ns, %llu samples\n",
+	       cpu, duration, threshold, loops);
+	printf("interruptions: %llu (%.1f/s)\n", hits, (double)hits / duration);
+	printf("max gap:       %llu ns\n", max);
+	printf("time lost:     %llu ns (%.4f%%)\n", lost,
+	       100.0 * lost / (t - start));
+	if (irqs_before >= 0 && irqs_after >= 0)
+		printf("timer irqs:    %lld (%.1f/s)\n",
+		       irqs_after - irqs_before,
+		       (double)(irqs_after - irqs_before) / duration);
+
+	printf("\n      gap (us)    count\n");
+	for (i = 0; i < NR_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		if (i == 0)
+			printf("          < 2 %8llu\n", hist[i]);
+		else if (i == NR_BUCKETS - 1)
+			printf("  >= %8u %8llu\n", 1U << i, hist[i]);
+		else
+			printf("%5u - %5u %8llu\n", 1U << i, 1U << (i + 1),
+			       hist[i]);
+	}
+
+	return 0;
+}
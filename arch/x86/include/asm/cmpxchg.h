@@ -1,5 +1,45 @@
+#ifndef ASM_X86_CMPXCHG_H
+#define ASM_X86_CMPXCHG_H
+
 #ifdef CONFIG_X86_32
 # include "cmpxchg_32.h"
 #else
 # include "cmpxchg_64.h"
 #endif
+
+/*
+ * Compare and exchange two adjacent, double word aligned words in one
+ * go: cmpxchg8b on 32 bit, cmpxchg16b on 64 bit.  Returns true if both
+ * old values matched and the new ones were stored.  Neither instruction
+ * is available on every processor, so callers must check
+ * system_has_cmpxchg_double() first.
+ */
+#define __cmpxchg_double(pfx, p1, p2, o1, o2, n1, n2)			\
+({									\
+	bool __ret;							\
+	__typeof__(*(p1)) __old1 = (o1), __new1 = (n1);			\
+	__typeof__(*(p2)) __old2 = (o2), __new2 = (n2);			\
+	BUILD_BUG_ON(sizeof(*(p1)) != sizeof(long));			\
+	BUILD_BUG_ON(sizeof(*(p2)) != sizeof(long));			\
+	asm volatile(pfx "cmpxchg%c4b %2; sete %0"			\
+		     : "=a" (__ret), "+d" (__old2),			\
+		       "+m" (*(p1)), "+m" (*(p2))			\
+		     : "i" (2 * sizeof(long)), "a" (__old1),		\
+		       "b" (__new1), "c" (__new2)			\
+		     : "memory");					\
+	__ret;								\
+})
+
+#define cmpxchg_double(p1, p2, o1, o2, n1, n2)				\
+	__cmpxchg_double(LOCK_PREFIX, p1, p2, o1, o2, n1, n2)
+
+#define cmpxchg_double_local(p1, p2, o1, o2, n1, n2)			\
+	__cmpxchg_double(, p1, p2, o1, o2, n1, n2)
+
+#ifdef CONFIG_X86_32
+#define system_has_cmpxchg_double()	boot_cpu_has(X86_FEATURE_CX8)
+#else
+#define system_has_cmpxchg_double()	boot_cpu_has(X86_FEATURE_CX16)
+#endif
+
+#endif /* ASM_X86_CMPXCHG_H */
@@ -77,7 +77,10 @@ static inline void __flush_tlb_one(unsigned long addr)
  *  - flush_tlb_page(vma, vmaddr) flushes one page
  *  - flush_tlb_range(vma, start, end) flushes a range of pages
  *  - flush_tlb_kernel_range(start, end) flushes a range of kernel pages
- *  - flush_tlb_others(cpumask, mm, va) flushes TLBs on other cpus
+ *  - flush_tlb_others(cpumask, mm, va) flushes TLBs on other cpus,
+ *    all of their user translations if mm is NULL
+ *  - arch_tlbbatch_flush(cpumask) flushes all user translations on
+ *    the given cpus, for the pages reclaim unmapped
  *
  * ..but the i386 has somewhat limited tlb flushing capabilities,
  * and page-granular flushes are available only on i486 and up.
@@ -85,7 +88,11 @@ static inline void __flush_tlb_one(unsigned long addr)
  * x86-64 can only flush individual pages or full VMs. For a range flush
  * we always do the full VM. Might be worth trying if for a small
  * range a few INVLPGs in a row are a win.
+ *
+ * Kernel ranges of up to TLB_KERNEL_FLUSH_CEILING pages are flushed page
+ * by page, which spares the global entries of the rest of the kernel.
  */
+#define TLB_KERNEL_FLUSH_CEILING	32
 
 #ifndef CONFIG_SMP
 
@@ -113,6 +120,20 @@ static inline void flush_tlb_range(struct vm_area_struct *vma,
 		__flush_tlb();
 }
 
+static inline void flush_tlb_kernel_range(unsigned long start,
+					  unsigned long end)
+{
+	unsigned long addr;
+
+	if (!cpu_has_invlpg ||
+	    end - start > TLB_KERNEL_FLUSH_CEILING * PAGE_SIZE) {
+		__flush_tlb_all();
+		return;
+	}
+	for (addr = start & PAGE_MASK; addr < end; addr += PAGE_SIZE)
+		__flush_tlb_single(addr);
+}
+
 static inline void native_flush_tlb_others(const struct cpumask *cpumask,
 					   struct mm_struct *mm,
 					   unsigned long va)
@@ -133,6 +154,7 @@ extern void flush_tlb_all(void);
 extern void flush_tlb_current_task(void);
 extern void flush_tlb_mm(struct mm_struct *);
 extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
+extern void flush_tlb_kernel_range(unsigned long start, unsigned long end);
 
 #define flush_tlb()	flush_tlb_current_task()
 
@@ -144,6 +166,7 @@ static inline void flush_tlb_range(struct vm_area_struct *vma,
 
 void native_flush_tlb_others(const struct cpumask *cpumask,
 			     struct mm_struct *mm, unsigned long va);
+extern void arch_tlbbatch_flush(const struct cpumask *cpumask);
 
 #define TLBSTATE_OK	1
 #define TLBSTATE_LAZY	2
@@ -166,10 +189,4 @@ static inline void reset_lazy_tlbstate(void)
 #define flush_tlb_others(mask, mm, va)	native_flush_tlb_others(mask, mm, va)
 #endif
 
-static inline void flush_tlb_kernel_range(unsigned long start,
-					  unsigned long end)
-{
-	flush_tlb_all();
-}
-
 #endif /* _ASM_X86_TLBFLUSH_H */
@@ -346,10 +346,13 @@
 #define __NR_fanotify_init	338
 #define __NR_fanotify_mark	339
 #define __NR_prlimit64		340
+/* 341 - 348 are the tagfs calls, see syscall_table_32.S */
+#define __NR_sched_setattr	349
+#define __NR_sched_getattr	350
 
 #ifdef __KERNEL__
 
-#define NR_syscalls 341
+#define NR_syscalls 351
 
 #define __ARCH_WANT_IPC_PARSE_VERSION
 #define __ARCH_WANT_OLD_READDIR
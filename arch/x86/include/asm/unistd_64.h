@@ -688,6 +688,11 @@ __SYSCALL(__NR_mvtag, sys_mvtag)
 #define __NR_distag 				310
 __SYSCALL(__NR_distag, sys_distag)
 
+#define __NR_sched_setattr			311
+__SYSCALL(__NR_sched_setattr, sys_sched_setattr)
+#define __NR_sched_getattr			312
+__SYSCALL(__NR_sched_getattr, sys_sched_getattr)
+
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
 #define __ARCH_WANT_OLD_STAT
@@ -1048,6 +1048,29 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	/*
+	 * Not-present faults are first tried without mmap_sem, see
+	 * handle_speculative_fault().  It leaves anything it cannot
+	 * handle, errors included, to the regular path below.
+	 */
+	if (!(error_code & PF_PROT)) {
+		fault = handle_speculative_fault(mm, address,
+					write ? FAULT_FLAG_WRITE : 0);
+		if (!(fault & VM_FAULT_RETRY)) {
+			if (fault & VM_FAULT_MAJOR) {
+				tsk->maj_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, 0,
+					      regs, address);
+			} else {
+				tsk->min_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, 0,
+					      regs, address);
+			}
+			check_v8086_mode(regs, address, tsk);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -152,7 +152,9 @@ void smp_invalidate_interrupt(struct pt_regs *regs)
 		 * BUG();
 		 */
 
-	if (f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
+	/* no mm: flush whatever this cpu has loaded */
+	if (!f->flush_mm ||
+	    f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
 		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK) {
 			if (f->flush_va == TLB_FLUSH_ALL)
 				local_flush_tlb();
@@ -161,6 +163,7 @@ void smp_invalidate_interrupt(struct pt_regs *regs)
 		} else
 			leave_mm(cpu);
 	}
+	count_vm_event(NR_TLB_REMOTE_FLUSH_RECEIVED);
 out:
 	ack_APIC_irq();
 	smp_mb__before_clear_bit();
@@ -208,6 +211,7 @@ static void flush_tlb_others_ipi(const struct cpumask *cpumask,
 void native_flush_tlb_others(const struct cpumask *cpumask,
 			     struct mm_struct *mm, unsigned long va)
 {
+	count_vm_event(NR_TLB_REMOTE_FLUSH);
 	if (is_uv_system()) {
 		unsigned int cpu;
 
@@ -282,6 +286,7 @@ void flush_tlb_current_task(void)
 
 	preempt_disable();
 
+	count_vm_event(NR_TLB_LOCAL_FLUSH_ALL);
 	local_flush_tlb();
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
 		flush_tlb_others(mm_cpumask(mm), mm, TLB_FLUSH_ALL);
@@ -293,9 +298,10 @@ void flush_tlb_mm(struct mm_struct *mm)
 	preempt_disable();
 
 	if (current->active_mm == mm) {
-		if (current->mm)
+		if (current->mm) {
+			count_vm_event(NR_TLB_LOCAL_FLUSH_ALL);
 			local_flush_tlb();
-		else
+		} else
 			leave_mm(smp_processor_id());
 	}
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
@@ -311,9 +317,10 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_disable();
 
 	if (current->active_mm == mm) {
-		if (current->mm)
+		if (current->mm) {
+			count_vm_event(NR_TLB_LOCAL_FLUSH_ONE);
 			__flush_tlb_one(va);
-		else
+		} else
 			leave_mm(smp_processor_id());
 	}
 
@@ -323,6 +330,23 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_enable();
 }
 
+/*
+ * Flush the TLB entries of the pages reclaim unmapped in a batch: all
+ * user translations on the given cpus, with a single round of IPIs.
+ */
+void arch_tlbbatch_flush(const struct cpumask *cpumask)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, cpumask)) {
+		count_vm_event(NR_TLB_LOCAL_FLUSH_ALL);
+		local_flush_tlb();
+	}
+	if (cpumask_any_but(cpumask, cpu) < nr_cpu_ids)
+		flush_tlb_others(cpumask, NULL, TLB_FLUSH_ALL);
+	put_cpu();
+}
+
 static void do_flush_tlb_all(void *info)
 {
 	__flush_tlb_all();
@@ -334,3 +358,32 @@ void flush_tlb_all(void)
 {
 	on_each_cpu(do_flush_tlb_all, NULL, 1);
 }
+
+struct flush_tlb_kernel_info {
+	unsigned long start;
+	unsigned long end;
+};
+
+static void do_flush_tlb_kernel_range(void *info)
+{
+	struct flush_tlb_kernel_info *f = info;
+	unsigned long addr;
+
+	for (addr = f->start; addr < f->end; addr += PAGE_SIZE)
+		__flush_tlb_single(addr);
+}
+
+void flush_tlb_kernel_range(unsigned long start, unsigned long end)
+{
+	struct flush_tlb_kernel_info info;
+
+	if (!cpu_has_invlpg ||
+	    end - start > TLB_KERNEL_FLUSH_CEILING * PAGE_SIZE) {
+		flush_tlb_all();
+		return;
+	}
+
+	info.start = start & PAGE_MASK;
+	info.end = end;
+	on_each_cpu(do_flush_tlb_kernel_range, &info, 1);
+}
@@ -0,0 +1,257 @@
+/*
+ * Compression streams for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/gfp.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zcomp.h"
+
+static void zcomp_strm_free(struct zcomp_strm *strm)
+{
+	if (strm->tfm && !IS_ERR(strm->tfm))
+		crypto_free_comp(strm->tfm);
+	free_pages((unsigned long)strm->buffer, 1);
+	kfree(strm);
+}
+
+/*
+ * Streams are only allocated when the device is set up or the limit
+ * is raised, never on the I/O path: crypto_alloc_comp() allocates
+ * with GFP_KERNEL, which could recurse into swap writeout to zram.
+ */
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
+{
+	struct zcomp_strm *strm;
+
+	strm = kzalloc(sizeof(*strm), GFP_KERNEL);
+	if (!strm)
+		return NULL;
+
+	strm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+	/*
+	 * Compressing incompressible data may produce more than a page
+	 * of output, so the buffer is two pages.
+	 */
+	strm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(strm->tfm) || !strm->buffer) {
+		zcomp_strm_free(strm);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&strm->list);
+	return strm;
+}
+
+/*
+ * Add streams to the idle list until there are max_strm of them.
+ * Called with strm_lock held, which is dropped while allocating.
+ */
+static int zcomp_strm_fill(struct zcomp *comp)
+{
+	struct zcomp_strm *strm;
+
+	while (comp->avail_strm < comp->max_strm) {
+		/* Count the new stream now so that others won't race us */
+		comp->avail_strm++;
+		spin_unlock(&comp->strm_lock);
+		strm = zcomp_strm_alloc(comp);
+		spin_lock(&comp->strm_lock);
+		if (!strm) {
+			comp->avail_strm--;
+			return -ENOMEM;
+		}
+		list_add(&strm->list, &comp->idle_strm);
+	}
+	return 0;
+}
+
+/**
+ * zcomp_available - check if a compression algorithm can be used
+ * @name: crypto API name of the algorithm
+ */
+int zcomp_available(const char *name)
+{
+	return crypto_has_comp(name, 0, 0);
+}
+
+/**
+ * zcomp_create - set up compression streams for an algorithm
+ * @name: crypto API name of the algorithm
+ * @max_strm: maximum number of concurrent streams
+ *
+ * All @max_strm streams are created here, so that writes never have
+ * to allocate one.  Returns an ERR_PTR on failure.
+ */
+struct zcomp *zcomp_create(const char *name, int max_strm)
+{
+	struct zcomp *comp;
+	struct zcomp_strm *strm;
+	int ret;
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return ERR_PTR(-ENOMEM);
+
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+	comp->max_strm = max(max_strm, 1);
+	strlcpy(comp->name, name, sizeof(comp->name));
+
+	strm = zcomp_strm_alloc(comp);
+	if (!strm) {
+		kfree(comp);
+		return ERR_PTR(-EINVAL);
+	}
+	list_add(&strm->list, &comp->idle_strm);
+	comp->avail_strm = 1;
+
+	spin_lock(&comp->strm_lock);
+	ret = zcomp_strm_fill(comp);
+	spin_unlock(&comp->strm_lock);
+	if (ret) {
+		zcomp_destroy(comp);
+		return ERR_PTR(ret);
+	}
+
+	return comp;
+}
+
+/**
+ * zcomp_destroy - free all streams
+ * @comp: streams to free, all of which must be idle
+ */
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *strm, *tmp;
+
+	list_for_each_entry_safe(strm, tmp, &comp->idle_strm, list) {
+		list_del(&strm->list);
+		zcomp_strm_free(strm);
+	}
+	kfree(comp);
+}
+
+/**
+ * zcomp_strm_find - get an idle stream
+ * @comp: stream pool
+ *
+ * Waits for a stream to become idle if all are busy.  May sleep.
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	struct zcomp_strm *strm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			strm = list_first_entry(&comp->idle_strm,
+					struct zcomp_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&comp->strm_lock);
+			return strm;
+		}
+		spin_unlock(&comp->strm_lock);
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+}
+
+/**
+ * zcomp_strm_release - return a stream to the idle list
+ * @comp: stream pool
+ * @strm: stream obtained from zcomp_strm_find()
+ */
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *strm)
+{
+	spin_lock(&comp->strm_lock);
+	if (comp->avail_strm <= comp->max_strm) {
+		list_add(&strm->list, &comp->idle_strm);
+		spin_unlock(&comp->strm_lock);
+		wake_up(&comp->strm_wait);
+		return;
+	}
+
+	/* The limit was lowered while the stream was in use */
+	comp->avail_strm--;
+	spin_unlock(&comp->strm_lock);
+	zcomp_strm_free(strm);
+}
+
+/**
+ * zcomp_set_max_streams - change the number of streams
+ * @comp: stream pool
+ * @max_strm: new number
+ *
+ * Idle streams above the new number are freed right away, busy ones
+ * as they are released.  Missing streams are created.  Returns
+ * -ENOMEM if not all of them could be.
+ */
+int zcomp_set_max_streams(struct zcomp *comp, int max_strm)
+{
+	struct zcomp_strm *strm;
+	int ret;
+
+	spin_lock(&comp->strm_lock);
+	comp->max_strm = max(max_strm, 1);
+	while (comp->avail_strm > comp->max_strm &&
+			!list_empty(&comp->idle_strm)) {
+		strm = list_first_entry(&comp->idle_strm,
+				struct zcomp_strm, list);
+		list_del(&strm->list);
+		comp->avail_strm--;
+		spin_unlock(&comp->strm_lock);
+		zcomp_strm_free(strm);
+		spin_lock(&comp->strm_lock);
+	}
+	ret = zcomp_strm_fill(comp);
+	spin_unlock(&comp->strm_lock);
+	/* Waiters may now find a new stream */
+	wake_up(&comp->strm_wait);
+
+	return ret;
+}
+
+/**
+ * zcomp_compress - compress one page into the stream's buffer
+ * @strm: stream to use
+ * @src: page to compress
+ * @dst_len: set to the compressed length
+ */
+int zcomp_compress(struct zcomp_strm *strm, const void *src,
+			unsigned int *dst_len)
+{
+	*dst_len = PAGE_SIZE << 1;
+	return crypto_comp_compress(strm->tfm, src, PAGE_SIZE,
+				strm->buffer, dst_len);
+}
+
+/**
+ * zcomp_decompress - decompress one page
+ * @strm: stream whose transform to use
+ * @src: compressed data
+ * @src_len: length of the compressed data
+ * @dst: page to decompress into
+ */
+int zcomp_decompress(struct zcomp_strm *strm, const void *src,
+			unsigned int src_len, void *dst)
+{
+	unsigned int dst_len = PAGE_SIZE;
+	int ret;
+
+	ret = crypto_comp_decompress(strm->tfm, src, src_len, dst, &dst_len);
+	if (!ret && dst_len != PAGE_SIZE)
+		ret = -EINVAL;
+
+	return ret;
+}
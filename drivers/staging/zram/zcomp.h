@@ -0,0 +1,60 @@
+/*
+ * Compression streams for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/crypto.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/* Default compression algorithm, looked up through the crypto API */
+#define ZCOMP_DEFAULT_ALG	"lzo"
+
+/*
+ * A compression stream: a crypto transform together with a buffer big
+ * enough for the worst case output of compressing one page.
+ */
+struct zcomp_strm {
+	struct crypto_comp *tfm;
+	void *buffer;			/* two pages */
+	struct list_head list;		/* in zcomp->idle_strm */
+};
+
+/*
+ * max_strm streams are created up front and kept on the idle list
+ * between uses.  Callers find all of them busy only when more than
+ * max_strm writes are compressing concurrently, and then wait.
+ */
+struct zcomp {
+	spinlock_t strm_lock;		/* protects the fields below */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	int avail_strm;			/* streams in existence */
+	int max_strm;
+
+	char name[CRYPTO_MAX_ALG_NAME];
+};
+
+int zcomp_available(const char *name);
+struct zcomp *zcomp_create(const char *name, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *strm);
+int zcomp_set_max_streams(struct zcomp *comp, int max_strm);
+
+int zcomp_compress(struct zcomp_strm *strm, const void *src,
+			unsigned int *dst_len);
+int zcomp_decompress(struct zcomp_strm *strm, const void *src,
+			unsigned int src_len, void *dst);
+
+#endif
@@ -0,0 +1,704 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc is a slab-like allocator for the compressed pages of zram.
+ *
+ * Objects are grouped in size classes ZS_SIZE_CLASS_DELTA bytes apart.
+ * Each class carves its objects out of "zspages": groups of up to
+ * ZS_MAX_PAGES_PER_ZSPAGE 0-order pages which are addressed as one
+ * contiguous area, so an object may start in one page and end in the
+ * next.  The number of pages per zspage is picked per class to leave as
+ * little space as possible unused at its end.  Pages are allocated one
+ * at a time and may come from highmem.
+ *
+ * Users get an opaque handle instead of an address.  An object must be
+ * mapped with zs_map_object() to be accessed; objects crossing a page
+ * boundary are assembled in a per-cpu buffer for that.  The handle is a
+ * small descriptor pointing at the object's current location, and the
+ * object's first word points back at the handle.  This is what allows
+ * zs_compact() to migrate objects out of sparsely used zspages and give
+ * the emptied zspages back to the system.
+ *
+ * Locking: each size class has a spinlock protecting its zspages.  A
+ * handle is pinned (HANDLE_PIN_BIT) while its object is mapped, freed or
+ * migrated; zs_compact() only try-pins, since it already holds the class
+ * lock.
+ */
+
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct size_class *get_size_class(struct zs_pool *pool, size_t size)
+{
+	unsigned int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+					ZS_SIZE_CLASS_DELTA);
+
+	return pool->size_class[idx];
+}
+
+static void pin_handle(struct zs_handle *zh)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, &zh->flags);
+}
+
+static int trypin_handle(struct zs_handle *zh)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, &zh->flags);
+}
+
+static void unpin_handle(struct zs_handle *zh)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, &zh->flags);
+}
+
+/*
+ * Pick the number of pages per zspage which wastes the smallest
+ * fraction of the zspage for objects of the given size.
+ */
+static unsigned int get_pages_per_zspage(unsigned int size)
+{
+	unsigned int i, best = 1, max_usedpc = 0;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		unsigned int zspage_size = i * PAGE_SIZE;
+		unsigned int waste = zspage_size % size;
+		unsigned int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max)
+		return ZS_FULL;
+	if (inuse * ZS_ALMOST_FULL_DEN <= max * ZS_ALMOST_FULL_NUM)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+				enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	list_add(&zspage->list, &class->fullness_list[fullness]);
+}
+
+static void remove_zspage(struct zspage *zspage)
+{
+	list_del_init(&zspage->list);
+}
+
+/*
+ * Move a zspage to the list matching its current number of objects.
+ * An empty zspage is left off all lists for the caller to free.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(class, zspage);
+
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	remove_zspage(zspage);
+	if (newfg == ZS_EMPTY)
+		zspage->fullness = ZS_EMPTY;
+	else
+		insert_zspage(class, zspage, newfg);
+
+	return newfg;
+}
+
+/*
+ * Object access. obj_offset() is the offset of a slot from the start of
+ * its zspage; the header word of a slot never straddles two pages.
+ */
+static unsigned long obj_offset(struct size_class *class, unsigned int idx)
+{
+	return (unsigned long)idx * class->size;
+}
+
+static unsigned long read_obj_header(struct size_class *class,
+				struct zspage *zspage, unsigned int idx)
+{
+	unsigned long offset = obj_offset(class, idx);
+	unsigned long *base, val;
+
+	base = kmap_atomic(zspage->pages[offset >> PAGE_SHIFT], KM_USER1);
+	val = *(unsigned long *)((char *)base + (offset & ~PAGE_MASK));
+	kunmap_atomic(base, KM_USER1);
+
+	return val;
+}
+
+static void write_obj_header(struct size_class *class, struct zspage *zspage,
+				unsigned int idx, unsigned long val)
+{
+	unsigned long offset = obj_offset(class, idx);
+	unsigned long *base;
+
+	base = kmap_atomic(zspage->pages[offset >> PAGE_SHIFT], KM_USER1);
+	*(unsigned long *)((char *)base + (offset & ~PAGE_MASK)) = val;
+	kunmap_atomic(base, KM_USER1);
+}
+
+/* Copy between a buffer and @len bytes at @offset within a zspage */
+static void copy_obj(struct zspage *zspage, unsigned long offset,
+			char *buf, unsigned int len, int to_obj)
+{
+	while (len) {
+		unsigned long off = offset & ~PAGE_MASK;
+		unsigned int n = min_t(unsigned long, len, PAGE_SIZE - off);
+		char *base;
+
+		base = kmap_atomic(zspage->pages[offset >> PAGE_SHIFT],
+					KM_USER1);
+		if (to_obj)
+			memcpy(base + off, buf, n);
+		else
+			memcpy(buf, base + off, n);
+		kunmap_atomic(base, KM_USER1);
+
+		offset += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Take the first free slot of a zspage for the object of @zh */
+static void obj_malloc(struct size_class *class, struct zspage *zspage,
+			struct zs_handle *zh)
+{
+	unsigned int idx = zspage->freeidx;
+	unsigned long next;
+
+	next = read_obj_header(class, zspage, idx) >> OBJ_TAG_BITS;
+	zspage->freeidx = (int)next - 1;
+	write_obj_header(class, zspage, idx,
+				(unsigned long)zh | OBJ_ALLOCATED_TAG);
+
+	zspage->inuse++;
+	class->objs_used++;
+
+	zh->zspage = zspage;
+	zh->obj_idx = idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	write_obj_header(class, zspage, idx,
+			(unsigned long)(zspage->freeidx + 1) << OBJ_TAG_BITS);
+	zspage->freeidx = idx;
+
+	zspage->inuse--;
+	class->objs_used--;
+}
+
+static void free_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	unsigned int i;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+
+	class->objs_allocated -= class->objs_per_zspage;
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+/*
+ * Allocate the pages of a new zspage and thread all of its slots on
+ * the free list.  The zspage is not put on any list yet.
+ */
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class)
+{
+	struct zspage *zspage;
+	unsigned int i;
+
+	zspage = kzalloc(sizeof(*zspage), pool->flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(pool->flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	for (i = 0; i < class->objs_per_zspage; i++) {
+		unsigned long next = 0;
+
+		if (i + 1 < class->objs_per_zspage)
+			next = (unsigned long)(i + 2) << OBJ_TAG_BITS;
+		write_obj_header(class, zspage, i, next);
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class_idx = class->index;
+	zspage->fullness = ZS_EMPTY;
+	zspage->freeidx = 0;
+
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+/* Prefer filling up zspages which are already well used */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	struct list_head *list;
+
+	list = &class->fullness_list[ZS_ALMOST_FULL];
+	if (list_empty(list))
+		list = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(list))
+		return NULL;
+
+	return list_first_entry(list, struct zspage, list);
+}
+
+/**
+ * zs_create_pool - create a pool to allocate objects from
+ * @name: name of the pool, used for its slab cache of handles
+ * @flags: allocation flags used for the pages backing the pool
+ *
+ * Returns the new pool, or NULL on failure.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	struct zs_pool *pool;
+	unsigned int i;
+	int cpu;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->flags = flags;
+	atomic_long_set(&pool->pages_allocated, 0);
+	atomic_long_set(&pool->pages_compacted, 0);
+
+	pool->name = kstrdup(name, GFP_KERNEL);
+	if (!pool->name)
+		goto fail;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class;
+		unsigned int fg;
+
+		class = kzalloc(sizeof(*class), GFP_KERNEL);
+		if (!class)
+			goto fail;
+
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+		class->index = i;
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+						class->size;
+		pool->size_class[i] = class;
+	}
+
+	pool->handle_cachep = kmem_cache_create(pool->name,
+				sizeof(struct zs_handle), 0, 0, NULL);
+	if (!pool->handle_cachep)
+		goto fail;
+
+	pool->area = alloc_percpu(struct mapping_area);
+	if (!pool->area)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = per_cpu_ptr(pool->area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf)
+			goto fail;
+	}
+
+	return pool;
+
+fail:
+	zs_destroy_pool(pool);
+	return NULL;
+}
+
+/**
+ * zs_destroy_pool - destroy a pool and free all of its memory
+ * @pool: pool to destroy
+ *
+ * All objects should have been freed with zs_free() by now.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	unsigned int i;
+	int cpu;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+		unsigned int fg;
+
+		if (!class)
+			continue;
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			struct zspage *zspage, *tmp;
+
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				pr_info("Freeing non-empty zspage: class=%u, "
+					"fullness=%u\n", i, fg);
+				free_zspage(pool, class, zspage);
+			}
+		}
+		kfree(class);
+	}
+
+	if (pool->area) {
+		for_each_possible_cpu(cpu)
+			kfree(per_cpu_ptr(pool->area, cpu)->vm_buf);
+		free_percpu(pool->area);
+	}
+
+	if (pool->handle_cachep)
+		kmem_cache_destroy(pool->handle_cachep);
+
+	kfree(pool->name);
+	kfree(pool);
+}
+
+/**
+ * zs_malloc - allocate an object from a pool
+ * @pool: pool to allocate from
+ * @size: size of the object
+ *
+ * Returns a handle to the new object, or 0 on failure.  Objects of up
+ * to ZS_MAX_ALLOC_SIZE minus one word can be allocated.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	struct zs_handle *zh;
+	struct zspage *zspage;
+	struct size_class *class;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	zh = kmem_cache_alloc(pool->handle_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!zh)
+		return 0;
+	zh->flags = 0;
+
+	class = get_size_class(pool, size + ZS_HANDLE_SIZE);
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(pool->handle_cachep, zh);
+			return 0;
+		}
+		spin_lock(&class->lock);
+		class->objs_allocated += class->objs_per_zspage;
+	}
+
+	obj_malloc(class, zspage, zh);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)zh;
+}
+
+/**
+ * zs_free - free an object
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ */
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *zh = (struct zs_handle *)handle;
+	struct zspage *zspage;
+	struct size_class *class;
+
+	if (unlikely(!handle))
+		return;
+
+	pin_handle(zh);
+	zspage = zh->zspage;
+	class = pool->size_class[zspage->class_idx];
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, zh->obj_idx);
+	if (fix_fullness_group(class, zspage) == ZS_EMPTY)
+		free_zspage(pool, class, zspage);
+	spin_unlock(&class->lock);
+	unpin_handle(zh);
+
+	kmem_cache_free(pool->handle_cachep, zh);
+}
+
+/**
+ * zs_map_object - get an address through which an object can be accessed
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ * @mm: how the object is going to be accessed
+ *
+ * The mapping must be released with zs_unmap_object() before the caller
+ * sleeps or maps another object.  The KM_USER1 kmap slot is in use in
+ * between; KM_USER0 remains available to the caller.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *zh = (struct zs_handle *)handle;
+	struct mapping_area *area;
+	struct size_class *class;
+	unsigned long offset, off;
+	unsigned int len;
+
+	BUG_ON(!handle);
+
+	/* Pinning also disables preemption, keeping us on this cpu's area */
+	pin_handle(zh);
+	class = pool->size_class[zh->zspage->class_idx];
+	offset = obj_offset(class, zh->obj_idx) + ZS_HANDLE_SIZE;
+	off = offset & ~PAGE_MASK;
+	len = class->size - ZS_HANDLE_SIZE;
+
+	area = this_cpu_ptr(pool->area);
+	area->vm_mm = mm;
+
+	if (off + len <= PAGE_SIZE) {
+		/* The object is within a single page */
+		area->page = zh->zspage->pages[offset >> PAGE_SHIFT];
+		area->vm_addr = (char *)kmap_atomic(area->page, KM_USER1) + off;
+		return area->vm_addr;
+	}
+
+	/* The object spans two pages: assemble it in the buffer */
+	area->page = NULL;
+	if (mm != ZS_MM_WO)
+		copy_obj(zh->zspage, offset, area->vm_buf, len, 0);
+	area->vm_addr = area->vm_buf;
+
+	return area->vm_addr;
+}
+
+/**
+ * zs_unmap_object - release a mapping set up by zs_map_object()
+ * @pool: pool the object was allocated from
+ * @handle: handle of the mapped object
+ */
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *zh = (struct zs_handle *)handle;
+	struct mapping_area *area;
+	struct size_class *class;
+	unsigned long offset;
+
+	area = this_cpu_ptr(pool->area);
+	if (area->page) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else if (area->vm_mm != ZS_MM_RO) {
+		class = pool->size_class[zh->zspage->class_idx];
+		offset = obj_offset(class, zh->obj_idx) + ZS_HANDLE_SIZE;
+		copy_obj(zh->zspage, offset, area->vm_buf,
+				class->size - ZS_HANDLE_SIZE, 1);
+	}
+	unpin_handle(zh);
+}
+
+/**
+ * zs_get_total_size_bytes - memory backing a pool
+ * @pool: pool to report on
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+
+/**
+ * zs_get_pool_stats - report how well the memory of a pool is used
+ * @pool: pool to report on
+ * @stats: filled in with the object counts of all size classes
+ */
+void zs_get_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	unsigned int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		spin_lock(&class->lock);
+		stats->objs_allocated += class->objs_allocated;
+		stats->objs_used += class->objs_used;
+		spin_unlock(&class->lock);
+	}
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+}
+
+/*
+ * Compaction
+ */
+
+/*
+ * The zspage with the fewest objects in use that is not full.  Every
+ * almost empty zspage is sparser than any almost full one.
+ */
+static struct zspage *find_sparsest_zspage(struct size_class *class)
+{
+	struct zspage *zspage, *sparsest = NULL;
+	struct list_head *list;
+
+	list = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(list))
+		list = &class->fullness_list[ZS_ALMOST_FULL];
+
+	list_for_each_entry(zspage, list, list)
+		if (!sparsest || zspage->inuse < sparsest->inuse)
+			sparsest = zspage;
+
+	return sparsest;
+}
+
+/*
+ * Move all objects of @src, which is off the lists, into other zspages
+ * of its class.  Returns 1 if @src ended up empty, 0 if an object was
+ * pinned or no room was found.
+ */
+static int migrate_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *src)
+{
+	char *buf = this_cpu_ptr(pool->area)->vm_buf;
+	unsigned int len = class->size - ZS_HANDLE_SIZE;
+	unsigned int idx;
+
+	for (idx = 0; idx < class->objs_per_zspage && src->inuse; idx++) {
+		unsigned long header = read_obj_header(class, src, idx);
+		struct zs_handle *zh;
+		struct zspage *dst;
+
+		if (!(header & OBJ_ALLOCATED_TAG))
+			continue;
+
+		dst = find_get_zspage(class);
+		if (!dst)
+			return 0;
+
+		zh = (struct zs_handle *)(header & ~OBJ_ALLOCATED_TAG);
+		if (!trypin_handle(zh))
+			continue;
+
+		copy_obj(src, obj_offset(class, idx) + ZS_HANDLE_SIZE,
+				buf, len, 0);
+		obj_malloc(class, dst, zh);
+		copy_obj(dst, obj_offset(class, zh->obj_idx) + ZS_HANDLE_SIZE,
+				buf, len, 1);
+		fix_fullness_group(class, dst);
+		obj_free(class, src, idx);
+
+		unpin_handle(zh);
+	}
+
+	return src->inuse == 0;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class)
+{
+	unsigned long freed = 0;
+	struct zspage *src;
+
+	spin_lock(&class->lock);
+	/*
+	 * As long as the free slots add up to at least a whole zspage, the
+	 * objects of the sparsest zspage are guaranteed to fit elsewhere.
+	 */
+	while (class->objs_allocated - class->objs_used >=
+			class->objs_per_zspage) {
+		src = find_sparsest_zspage(class);
+		if (!src)
+			break;
+
+		remove_zspage(src);
+		if (!migrate_zspage(pool, class, src)) {
+			insert_zspage(class, src,
+					get_fullness_group(class, src));
+			break;
+		}
+
+		free_zspage(pool, class, src);
+		freed += class->pages_per_zspage;
+
+		spin_unlock(&class->lock);
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - migrate objects to free sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Returns the number of pages given back to the system.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long freed = 0;
+	unsigned int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		freed += zs_compact_class(pool, pool->size_class[i]);
+
+	atomic_long_add(freed, &pool->pages_compacted);
+	return freed;
+}
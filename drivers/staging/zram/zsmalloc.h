@@ -0,0 +1,50 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+/*
+ * How a mapped object is going to be accessed.  For objects which
+ * straddle a page boundary this tells zs_map_object() whether it must
+ * gather the current contents and zs_unmap_object() whether it must
+ * scatter them back.
+ */
+enum zs_mapmode {
+	ZS_MM_RW,	/* read and write */
+	ZS_MM_RO,	/* read only */
+	ZS_MM_WO,	/* write only: contents on map are undefined */
+};
+
+struct zs_pool_stats {
+	u64 objs_allocated;	/* object slots in all zspages */
+	u64 objs_used;		/* of which are holding an object */
+	u64 pages_compacted;	/* pages freed by zs_compact() so far */
+};
+
+struct zs_pool;
+
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags);
+void zs_destroy_pool(struct zs_pool *pool);
+
+unsigned long zs_malloc(struct zs_pool *pool, size_t size);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm);
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+void zs_get_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats);
+unsigned long zs_compact(struct zs_pool *pool);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+#include "zsmalloc.h"
+
+/* User configurable params */
+
+/*
+ * A zspage is a group of up to this many 0-order pages which are
+ * treated as one contiguous area, so that objects may cross the
+ * boundary between two of its pages.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * Object sizes, including the handle stored in front of each one.
+ * Every size class is a multiple of ZS_ALIGN, so an object header
+ * never straddles two pages.
+ */
+#define ZS_ALIGN		16
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/* Size classes are separated by this many bytes: a multiple of ZS_ALIGN */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * A zspage with at most this fraction of its objects in use is
+ * considered almost empty.
+ */
+#define ZS_ALMOST_FULL_NUM	3
+#define ZS_ALMOST_FULL_DEN	4
+
+/* End of user params */
+
+/*
+ * The first word of every object slot:
+ *  - allocated: the handle of the object, with OBJ_ALLOCATED_TAG set
+ *  - free: index of the next free slot plus one, shifted left by
+ *    OBJ_TAG_BITS; zero ends the free list
+ */
+#define OBJ_TAG_BITS		1
+#define OBJ_ALLOCATED_TAG	1UL
+#define ZS_HANDLE_SIZE		sizeof(unsigned long)
+
+/* Bit of zs_handle->flags held while an object is mapped or moved */
+#define HANDLE_PIN_BIT		0
+
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,	/* never on a list: freed right away */
+};
+
+/*
+ * Handles are pointers to one of these, which lets zs_compact() move
+ * an object without its user noticing.
+ */
+struct zs_handle {
+	unsigned long flags;
+	struct zspage *zspage;
+	unsigned int obj_idx;
+};
+
+struct zspage {
+	struct list_head list;		/* in class->fullness_list */
+	unsigned int class_idx;
+	unsigned int inuse;
+	enum fullness_group fullness;
+	int freeidx;			/* first free slot, -1 if none */
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+
+	unsigned int index;
+	unsigned int size;		/* object size, handle included */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+
+	/* stats */
+	u64 objs_allocated;
+	u64 objs_used;
+};
+
+/*
+ * Per-cpu area in which objects straddling two pages are assembled
+ * while they are mapped.
+ */
+struct mapping_area {
+	char *vm_buf;			/* copy buffer, ZS_MAX_ALLOC_SIZE */
+	char *vm_addr;			/* address handed to the user */
+	struct page *page;		/* kmapped page, NULL if copied */
+	enum zs_mapmode vm_mm;
+};
+
+struct zs_pool {
+	const char *name;
+	gfp_t flags;
+	struct kmem_cache *handle_cachep;
+	struct mapping_area __percpu *area;
+
+	struct size_class *size_class[ZS_SIZE_CLASSES];
+
+	/* stats */
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+};
+
+#endif
@@ -585,14 +585,26 @@ static void __writeback_inodes_sb(struct super_block *sb,
 }
 
 /*
- * The maximum number of pages to writeout in a single bdi flush/kupdate
+ * The minimum number of pages to writeout in a single bdi flush/kupdate
  * operation.  We do this so we don't hold I_SYNC against an inode for
- * enormous amounts of time, which would block a userspace task which has
- * been forced to throttle against that inode.  Also, the code reevaluates
- * the dirty each time it has written this many pages.
+ * enormous amounts of time.  Also, the code reevaluates the dirty each
+ * time it has written this many pages.
  */
 #define MAX_WRITEBACK_PAGES     1024
 
+/*
+ * The flusher threads do all the writeback for throttled dirtiers, so
+ * write about half a second's worth of pages at a time on fast devices
+ * to keep the I/O efficient, in multiples of MAX_WRITEBACK_PAGES.
+ */
+static long writeback_chunk_size(struct backing_dev_info *bdi)
+{
+	long pages = bdi->avg_write_bandwidth / 2;
+
+	return max_t(long, MAX_WRITEBACK_PAGES,
+		     round_down(pages, MAX_WRITEBACK_PAGES));
+}
+
 static inline bool over_bground_thresh(void)
 {
 	unsigned long background_thresh, dirty_thresh;
@@ -686,6 +698,9 @@ static long wb_writeback(struct bdi_writeback *wb,
 		if (work->for_background && !over_bground_thresh())
 			break;
 
+		if (wbc.sync_mode == WB_SYNC_NONE)
+			write_chunk = writeback_chunk_size(wb->bdi);
+
 		wbc.more_io = 0;
 		wbc.nr_to_write = write_chunk;
 		wbc.pages_skipped = 0;
@@ -697,6 +712,8 @@ static long wb_writeback(struct bdi_writeback *wb,
 			writeback_inodes_wb(wb, &wbc);
 		trace_wbc_writeback_written(&wbc, wb->bdi);
 
+		bdi_update_bandwidth(wb->bdi, wbc.wb_start);
+
 		work->nr_pages -= write_chunk - wbc.nr_to_write;
 		wrote += write_chunk - wbc.nr_to_write;
 
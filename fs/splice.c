@@ -390,6 +390,7 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 		 */
 		this_len = min_t(unsigned long, len, PAGE_CACHE_SIZE - loff);
 		page = spd.pages[page_nr];
+		mark_page_accessed(page);
 
 		if (PageReadahead(page))
 			page_cache_async_readahead(mapping, &in->f_ra, in,
@@ -40,6 +40,8 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_DIRTIED,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
@@ -76,6 +78,24 @@ struct backing_dev_info {
 	struct prop_local_percpu completions;
 	int dirty_exceeded;
 
+	/*
+	 * Write bandwidth and dirty rate estimation, updated every 200ms
+	 * by bdi_update_bandwidth().  All rates are in pages per second.
+	 */
+	unsigned long bw_time_stamp;	/* last time the estimates were updated */
+	unsigned long dirtied_stamp;	/* BDI_DIRTIED at bw_time_stamp */
+	unsigned long written_stamp;	/* BDI_WRITTEN at bw_time_stamp */
+	unsigned long write_bandwidth;	/* estimated write bandwidth */
+	unsigned long avg_write_bandwidth; /* further smoothed write bandwidth */
+
+	/*
+	 * The base rate at which each task dirtying pages on this bdi is
+	 * allowed to do so.  dirty_ratelimit follows the noisy estimate
+	 * balanced_dirty_ratelimit in small steps.
+	 */
+	unsigned long dirty_ratelimit;
+	unsigned long balanced_dirty_ratelimit;
+
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
@@ -648,6 +648,7 @@ struct address_space {
 	spinlock_t		i_mmap_lock;	/* protect tree, count, list */
 	unsigned int		truncate_count;	/* Cover race condition with truncate */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -927,6 +928,18 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	/*
+	 * Offsets of the last RA_HISTORY cache misses, to recognize
+	 * strided and backward reading.  While such a stream is being
+	 * read ahead, @stride is its distance in pages, @start is the
+	 * first chunk of the last batch, @size the pages in the batch
+	 * and @async_size the pages in each chunk.
+	 */
+#define RA_HISTORY	4		/* power of two */
+	pgoff_t history[RA_HISTORY];
+	unsigned int history_idx;	/* total misses recorded */
+	long stride;			/* 0 if not strided */
 };
 
 /*
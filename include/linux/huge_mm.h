@@ -8,6 +8,10 @@ extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
 extern int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 			 pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 			 struct vm_area_struct *vma);
+extern int do_huge_pmd_shmem_page(struct mm_struct *mm,
+				  struct vm_area_struct *vma,
+				  unsigned long address, pmd_t *pmd,
+				  unsigned int flags);
 extern int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			       unsigned long address, pmd_t *pmd,
 			       pmd_t orig_pmd);
@@ -82,12 +86,13 @@ extern int handle_pte_fault(struct mm_struct *mm,
 			    struct vm_area_struct *vma, unsigned long address,
 			    pte_t *pte, pmd_t *pmd, unsigned int flags);
 extern int split_huge_page(struct page *page);
-extern void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd);
-#define split_huge_page_pmd(__mm, __pmd)				\
+extern void __split_huge_page_pmd(struct mm_struct *mm, unsigned long address,
+				  pmd_t *pmd);
+#define split_huge_page_pmd(__mm, __address, __pmd)			\
 	do {								\
 		pmd_t *____pmd = (__pmd);				\
 		if (unlikely(pmd_trans_huge(*____pmd)))			\
-			__split_huge_page_pmd(__mm, ____pmd);		\
+			__split_huge_page_pmd(__mm, __address, ____pmd);\
 	}  while (0)
 #define wait_split_huge_page(__anon_vma, __pmd)				\
 	do {								\
@@ -108,6 +113,7 @@ extern void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd);
 #endif
 extern int hugepage_madvise(struct vm_area_struct *vma,
 			    unsigned long *vm_flags, int advice);
+extern void split_huge_page_vma(struct vm_area_struct *vma);
 extern void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 				    unsigned long start,
 				    unsigned long end,
@@ -117,7 +123,9 @@ static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
 					 unsigned long end,
 					 long adjust_next)
 {
-	if (!vma->anon_vma || vma->vm_ops || vma->vm_file)
+	/* shared mappings may have shmem extents mapped by huge pmds */
+	if ((!vma->anon_vma || vma->vm_ops || vma->vm_file) &&
+	    !(vma->vm_flags & VM_SHARED))
 		return;
 	__vma_adjust_trans_huge(vma, start, end, adjust_next);
 }
@@ -158,7 +166,7 @@ static inline int split_huge_page(struct page *page)
 {
 	return 0;
 }
-#define split_huge_page_pmd(__mm, __pmd)	\
+#define split_huge_page_pmd(__mm, __address, __pmd)	\
 	do { } while (0)
 #define wait_split_huge_page(__anon_vma, __pmd)	\
 	do { } while (0)
@@ -169,6 +177,9 @@ static inline int hugepage_madvise(struct vm_area_struct *vma,
 	BUG();
 	return 0;
 }
+static inline void split_huge_page_vma(struct vm_area_struct *vma)
+{
+}
 static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
 					 unsigned long start,
 					 unsigned long end,
@@ -177,4 +188,30 @@ static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
 }
 #endif /* CONFIG_TRANSPARENT_HUGEPAGE */
 
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && defined(CONFIG_SHMEM)
+extern int shmem_huge_enabled(struct vm_area_struct *vma);
+extern int shmem_pmd_clear_flush_young(struct page *page,
+				       struct vm_area_struct *vma,
+				       unsigned long address);
+extern int shmem_pmd_unmap(struct page *page, struct vm_area_struct *vma,
+			   unsigned long address);
+#else
+static inline int shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	return 0;
+}
+static inline int shmem_pmd_clear_flush_young(struct page *page,
+					      struct vm_area_struct *vma,
+					      unsigned long address)
+{
+	return -1;
+}
+static inline int shmem_pmd_unmap(struct page *page,
+				  struct vm_area_struct *vma,
+				  unsigned long address)
+{
+	return 0;
+}
+#endif
+
 #endif /* _LINUX_HUGE_MM_H */
@@ -31,9 +31,22 @@ struct shmem_sb_info {
 	uid_t uid;		    /* Mount uid for root directory */
 	gid_t gid;		    /* Mount gid for root directory */
 	mode_t mode;		    /* Mount mode for root directory */
+	int huge;		    /* When to use huge pages: SHMEM_HUGE_* */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
 };
 
+/*
+ * Per-mount huge page policies, set with huge= at mount time.  DENY and
+ * FORCE are only used for the global shmem_enabled knob in sysfs, to
+ * override every mount for testing or in an emergency.
+ */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_ALWAYS	1
+#define SHMEM_HUGE_WITHIN_SIZE	2
+#define SHMEM_HUGE_ADVISE	3
+#define SHMEM_HUGE_DENY		(-1)
+#define SHMEM_HUGE_FORCE	(-2)
+
 static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
 {
 	return container_of(inode, struct shmem_inode_info, vfs_inode);
@@ -42,4 +55,13 @@ static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
 extern int init_tmpfs(void);
 extern int shmem_fill_super(struct super_block *sb, void *data, int silent);
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+extern struct page *shmem_huge_extent(struct vm_area_struct *vma,
+				      pgoff_t hindex);
+extern int shmem_collapse_extent(struct inode *inode, pgoff_t hindex);
+#ifdef CONFIG_SYSFS
+extern struct kobj_attribute shmem_enabled_attr;
+#endif
+#endif
+
 #endif
@@ -667,6 +667,22 @@ static inline struct sk_buff *skb_get(struct sk_buff *skb)
 	return skb;
 }
 
+/**
+ *	skb_unref - drop a reference to a buffer
+ *	@skb: buffer
+ *
+ *	Returns true if that was the last reference and the buffer is to
+ *	be freed.
+ */
+static inline bool skb_unref(struct sk_buff *skb)
+{
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return false;
+	return true;
+}
+
 /*
  * If users == 1, we are the only owner and are can avoid redundant
  * atomic change.
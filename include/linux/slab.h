@@ -107,6 +107,15 @@ void kmem_cache_free(struct kmem_cache *, void *);
 unsigned int kmem_cache_size(struct kmem_cache *);
 const char *kmem_cache_name(struct kmem_cache *);
 
+/*
+ * Bulk allocation and freeing. The allocators amortize the per object
+ * cost (irq disabling, per cpu access, list locking) over the array.
+ * kmem_cache_alloc_bulk() allocates all objects or none and returns the
+ * number allocated; it must be called with interrupts enabled.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *, gfp_t, size_t, void **);
+void kmem_cache_free_bulk(struct kmem_cache *, size_t, void **);
+
 /*
  * Please use this macro to create slab caches. Simply specify the
  * name of the structure and maybe some flags that are listed above.
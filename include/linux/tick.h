@@ -67,6 +67,12 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	int				full_stopped;
+	unsigned long			full_jiffies;
+	unsigned long			full_stops;
+	int				full_kick_pending;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -139,4 +145,28 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+#ifdef CONFIG_NO_HZ_FULL
+extern bool tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return false;
+
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_kick(void);
+extern void tick_nohz_full_update_tick(void);
+extern void tick_nohz_full_task_switch(void);
+#else
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_full_kick(void) { }
+static inline void tick_nohz_full_update_tick(void) { }
+static inline void tick_nohz_full_task_switch(void) { }
+#endif /* !NO_HZ_FULL */
+
 #endif
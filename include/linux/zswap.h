@@ -0,0 +1,45 @@
+#ifndef _LINUX_ZSWAP_H
+#define _LINUX_ZSWAP_H
+/*
+ * Compressed cache for swap pages.
+ *
+ * zswap sits between swap_writepage()/swap_readpage() and the swap device,
+ * keeping compressed copies of outgoing anonymous pages in RAM and writing
+ * the coldest of them back to the device when its pool fills up.
+ */
+
+#include <linux/errno.h>
+#include <linux/types.h>
+#include <linux/mm_types.h>
+
+#ifdef CONFIG_ZSWAP
+extern int zswap_store(struct page *page);
+extern int zswap_load(struct page *page);
+extern void zswap_invalidate_page(unsigned type, pgoff_t offset);
+extern void zswap_init_area(unsigned type);
+extern void zswap_invalidate_area(unsigned type);
+#else
+static inline int zswap_store(struct page *page)
+{
+	return -ENODEV;
+}
+
+static inline int zswap_load(struct page *page)
+{
+	return -ENODEV;
+}
+
+static inline void zswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+}
+
+static inline void zswap_init_area(unsigned type)
+{
+}
+
+static inline void zswap_invalidate_area(unsigned type)
+{
+}
+#endif
+
+#endif /* _LINUX_ZSWAP_H */
@@ -1298,6 +1298,27 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * posix_cpu_timers_can_stop_tick - check the CPU timers of a task
+ *
+ * @tsk:	The task running on a full dynticks cpu.
+ *
+ * Return false if the task or its thread group has timers armed, as
+ * those are expired from the timer interrupt.
+ */
+int posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return 0;
+
+	if (tsk->signal->cputimer.running)
+		return 0;
+
+	return 1;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -47,6 +47,10 @@
 #include <linux/mutex.h>
 #include <linux/time.h>
 #include <linux/kernel_stat.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/bootmem.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 
@@ -104,6 +108,7 @@ void rcu_sched_qs(int cpu)
 	rdp->passed_quiesc_completed = rdp->gpnum - 1;
 	barrier();
 	rdp->passed_quiesc = 1;
+	rcu_sched_exp_qs(cpu);
 }
 
 void rcu_bh_qs(int cpu)
@@ -1224,6 +1229,7 @@ void rcu_check_callbacks(int cpu, int user)
 		rcu_bh_qs(cpu);
 	}
 	rcu_preempt_check_callbacks(cpu);
+	rcu_nocb_do_deferred_wakeup(cpu);
 	if (rcu_pending(cpu))
 		raise_softirq(RCU_SOFTIRQ);
 }
@@ -1416,7 +1422,7 @@ static void rcu_process_callbacks(struct softirq_action *unused)
 
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, int nocb)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1436,6 +1442,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* Hand the callback to this CPU's offload kthread, if any. */
+	if (nocb && __call_rcu_nocb(rdp, head, flags)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1479,7 +1491,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1488,7 +1500,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1650,7 +1662,8 @@ static int rcu_needs_cpu_quick_check(int cpu)
 	/* RCU callbacks either ready or pending? */
 	return per_cpu(rcu_sched_data, cpu).nxtlist ||
 	       per_cpu(rcu_bh_data, cpu).nxtlist ||
-	       rcu_preempt_needs_cpu(cpu);
+	       rcu_preempt_needs_cpu(cpu) ||
+	       rcu_nocb_need_deferred_wakeup(cpu);
 }
 
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
@@ -1750,6 +1763,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	rdp->dynticks = &per_cpu(rcu_dynticks, cpu);
 #endif /* #ifdef CONFIG_NO_HZ */
 	rdp->cpu = cpu;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -1968,6 +1982,7 @@ void __init rcu_init(void)
 	rcu_init_one(&rcu_sched_state, &rcu_sched_data);
 	rcu_init_one(&rcu_bh_state, &rcu_bh_data);
 	__rcu_init_preempt();
+	rcu_init_nocb();
 	open_softirq(RCU_SOFTIRQ, rcu_process_callbacks);
 
 	/*
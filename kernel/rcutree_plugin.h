@@ -25,7 +25,6 @@
  */
 
 #include <linux/delay.h>
-#include <linux/stop_machine.h>
 
 /*
  * Check the RCU kernel configuration parameters and print informative
@@ -550,7 +549,7 @@ static void rcu_preempt_process_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -1023,119 +1022,152 @@ void synchronize_sched_expedited(void)
 }
 EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
 
+static void rcu_sched_exp_qs(int cpu)
+{
+}
+
 #else /* #ifndef CONFIG_SMP */
 
+static DEFINE_MUTEX(sync_sched_expedited_mutex);
 static atomic_t sync_sched_expedited_started = ATOMIC_INIT(0);
 static atomic_t sync_sched_expedited_done = ATOMIC_INIT(0);
+static atomic_t sync_sched_expedited_pending = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(sync_sched_expedited_wq);
+static DEFINE_PER_CPU(int, rcu_sched_exp_needed);
 
-static int synchronize_sched_expedited_cpu_stop(void *data)
+/*
+ * Report this CPU's quiescent state to the expedited grace period in
+ * progress, if it is still waiting on this CPU.  Called from
+ * rcu_sched_qs(), so on every context switch, and from the IPI handler
+ * when the IPI interrupted the idle loop.
+ */
+static void rcu_sched_exp_qs(int cpu)
+{
+	if (likely(!per_cpu(rcu_sched_exp_needed, cpu)))
+		return;
+
+	/* xchg() implies a full memory barrier, ordering prior readers. */
+	if (!xchg(&per_cpu(rcu_sched_exp_needed, cpu), 0))
+		return;
+	if (atomic_dec_and_test(&sync_sched_expedited_pending))
+		wake_up(&sync_sched_expedited_wq);
+}
+
+#ifdef CONFIG_NO_HZ
+
+/*
+ * Is the specified CPU in dynticks-idle mode with no irq or NMI handler
+ * running?  Such a CPU is in an extended quiescent state, cannot be
+ * within an RCU-sched read-side critical section, and therefore need
+ * not be disturbed by the expedited grace period.  The caller must
+ * have executed a full memory barrier since the grace period started.
+ */
+static int rcu_sched_exp_cpu_idle(int cpu)
+{
+	struct rcu_dynticks *rdtp = &per_cpu(rcu_dynticks, cpu);
+
+	return (ACCESS_ONCE(rdtp->dynticks) & 0x1) == 0 &&
+	       (ACCESS_ONCE(rdtp->dynticks_nmi) & 0x1) == 0;
+}
+
+#else /* #ifdef CONFIG_NO_HZ */
+
+static int rcu_sched_exp_cpu_idle(int cpu)
 {
-	/*
-	 * There must be a full memory barrier on each affected CPU
-	 * between the time that try_stop_cpus() is called and the
-	 * time that it returns.
-	 *
-	 * In the current initial implementation of cpu_stop, the
-	 * above condition is already met when the control reaches
-	 * this point and the following smp_mb() is not strictly
-	 * necessary.  Do smp_mb() anyway for documentation and
-	 * robustness against future implementation changes.
-	 */
-	smp_mb(); /* See above comment block. */
 	return 0;
 }
 
+#endif /* #else #ifdef CONFIG_NO_HZ */
+
+/*
+ * IPI handler for the expedited grace period.  If the IPI interrupted
+ * the idle loop, the CPU is in a quiescent state, so report it right
+ * away.  Otherwise ask for a reschedule: the resulting context switch
+ * reports the quiescent state through rcu_sched_qs().
+ */
+static void synchronize_sched_expedited_ipi(void *unused)
+{
+	int cpu = smp_processor_id();
+
+	if (!per_cpu(rcu_sched_exp_needed, cpu))
+		return;
+	if (idle_cpu(cpu) &&
+	    !in_softirq() && hardirq_count() <= (1 << HARDIRQ_SHIFT)) {
+		rcu_sched_exp_qs(cpu);
+		return;
+	}
+	set_need_resched();
+}
+
 /*
  * Wait for an rcu-sched grace period to elapse, but use "big hammer"
- * approach to force grace period to end quickly.  This consumes
- * significant time on all CPUs, and is thus not recommended for
- * any sort of common-case code.
+ * approach to force grace period to end quickly.  This interrupts
+ * every online CPU which is not in dynticks-idle mode, and is thus
+ * not recommended for any sort of common-case code.
+ *
+ * Each CPU still to be waited on is flagged and sent an IPI.  Its next
+ * context switch, or the IPI itself if it lands in the idle loop,
+ * clears the flag and drops sync_sched_expedited_pending.  When that
+ * reaches zero, every CPU has passed through a quiescent state since
+ * the start of the expedited grace period.  CPUs idle in dynticks mode
+ * are skipped, so that isolated or sleeping CPUs are not woken up.
+ *
+ * Only one expedited grace period runs at a time, serialized by
+ * sync_sched_expedited_mutex.  Concurrent callers are batched with
+ * a pair of tickets: each caller increments
+ * sync_sched_expedited_started on entry, and each grace period
+ * snapshots it before looking at any CPU and stores the snapshot into
+ * sync_sched_expedited_done once complete.  A caller who finds that
+ * sync_sched_expedited_done has reached its ticket once it acquires
+ * the mutex was covered by a grace period that started after its
+ * arrival, and returns without starting another one.
  *
  * Note that it is illegal to call this function while holding any
  * lock that is acquired by a CPU-hotplug notifier.  Failing to
  * observe this restriction will result in deadlock.
- *
- * This implementation can be thought of as an application of ticket
- * locking to RCU, with sync_sched_expedited_started and
- * sync_sched_expedited_done taking on the roles of the halves
- * of the ticket-lock word.  Each task atomically increments
- * sync_sched_expedited_started upon entry, snapshotting the old value,
- * then attempts to stop all the CPUs.  If this succeeds, then each
- * CPU will have executed a context switch, resulting in an RCU-sched
- * grace period.  We are then done, so we use atomic_cmpxchg() to
- * update sync_sched_expedited_done to match our snapshot -- but
- * only if someone else has not already advanced past our snapshot.
- *
- * On the other hand, if try_stop_cpus() fails, we check the value
- * of sync_sched_expedited_done.  If it has advanced past our
- * initial snapshot, then someone else must have forced a grace period
- * some time after we took our snapshot.  In this case, our work is
- * done for us, and we can simply return.  Otherwise, we try again,
- * but keep our initial snapshot for purposes of checking for someone
- * doing our work for us.
- *
- * If we fail too many times in a row, we fall back to synchronize_sched().
  */
 void synchronize_sched_expedited(void)
 {
-	int firstsnap, s, snap, trycount = 0;
+	int cpu, s, snap;
 
 	/* Note that atomic_inc_return() implies full memory barrier. */
-	firstsnap = snap = atomic_inc_return(&sync_sched_expedited_started);
-	get_online_cpus();
+	snap = atomic_inc_return(&sync_sched_expedited_started);
+	mutex_lock(&sync_sched_expedited_mutex);
+
+	/* Check to see if someone else did our work for us. */
+	s = atomic_read(&sync_sched_expedited_done);
+	if (UINT_CMP_GE((unsigned)s, (unsigned)snap)) {
+		mutex_unlock(&sync_sched_expedited_mutex);
+		smp_mb(); /* ensure test happens before caller kfree */
+		return;
+	}
 
 	/*
-	 * Each pass through the following loop attempts to force a
-	 * context switch on each CPU.
+	 * Everyone who incremented sync_sched_expedited_started up to
+	 * now is covered by the grace period we are about to start.
 	 */
-	while (try_stop_cpus(cpu_online_mask,
-			     synchronize_sched_expedited_cpu_stop,
-			     NULL) == -EAGAIN) {
-		put_online_cpus();
-
-		/* No joy, try again later.  Or just synchronize_sched(). */
-		if (trycount++ < 10)
-			udelay(trycount * num_online_cpus());
-		else {
-			synchronize_sched();
-			return;
-		}
-
-		/* Check to see if someone else did our work for us. */
-		s = atomic_read(&sync_sched_expedited_done);
-		if (UINT_CMP_GE((unsigned)s, (unsigned)firstsnap)) {
-			smp_mb(); /* ensure test happens before caller kfree */
-			return;
-		}
+	get_online_cpus();
+	snap = atomic_read(&sync_sched_expedited_started);
+	smp_mb(); /* ensure read is before looking at the CPUs. */
 
-		/*
-		 * Refetching sync_sched_expedited_started allows later
-		 * callers to piggyback on our grace period.  We subtract
-		 * 1 to get the same token that the last incrementer got.
-		 * We retry after they started, so our grace period works
-		 * for them, and they started after our first try, so their
-		 * grace period works for us.
-		 */
-		get_online_cpus();
-		snap = atomic_read(&sync_sched_expedited_started) - 1;
-		smp_mb(); /* ensure read is before try_stop_cpus(). */
+	/* Hold a reference so that the count cannot hit zero early. */
+	atomic_set(&sync_sched_expedited_pending, 1);
+	for_each_online_cpu(cpu) {
+		if (rcu_sched_exp_cpu_idle(cpu))
+			continue;
+		atomic_inc(&sync_sched_expedited_pending);
+		per_cpu(rcu_sched_exp_needed, cpu) = 1;
+		smp_call_function_single(cpu, synchronize_sched_expedited_ipi,
+					 NULL, 0);
 	}
+	if (!atomic_dec_and_test(&sync_sched_expedited_pending))
+		wait_event(sync_sched_expedited_wq,
+			   !atomic_read(&sync_sched_expedited_pending));
+	smp_mb(); /* ensure quiescent states happen before caller kfree */
 
-	/*
-	 * Everyone up to our most recent fetch is covered by our grace
-	 * period.  Update the counter, but only if our work is still
-	 * relevant -- which it won't be if someone who started later
-	 * than we did beat us to the punch.
-	 */
-	do {
-		s = atomic_read(&sync_sched_expedited_done);
-		if (UINT_CMP_GE((unsigned)s, (unsigned)snap)) {
-			smp_mb(); /* ensure test happens before caller kfree */
-			break;
-		}
-	} while (atomic_cmpxchg(&sync_sched_expedited_done, s, snap) != s);
-
+	atomic_set(&sync_sched_expedited_done, snap);
 	put_online_cpus();
+	mutex_unlock(&sync_sched_expedited_mutex);
 }
 EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
 
@@ -1260,3 +1292,290 @@ static void rcu_needs_cpu_flush(void)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback invocation to kthreads.  CPUs listed in rcu_nocbs=
+ * do not invoke their RCU callbacks from softirq.  Instead, call_rcu()
+ * appends the callbacks to a per-CPU list without taking any lock, and
+ * an "rcuo" kthread per CPU grabs the whole list, waits for a grace
+ * period, and invokes the batch.  The kthreads are ordinary tasks whose
+ * affinity and priority can be set like those of any other kthread.
+ * The boot CPU always invokes its own callbacks.
+ */
+
+static cpumask_var_t rcu_nocb_mask;	/* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;		/* Was rcu_nocb_mask allocated? */
+
+static int rcu_nocb_kthread_prio;	/* SCHED_FIFO priority, 0 for normal. */
+module_param(rcu_nocb_kthread_prio, int, 0444);
+
+static DEFINE_PER_CPU(struct task_struct *, rcu_nocb_task);
+static DEFINE_PER_CPU(wait_queue_head_t, rcu_nocb_wq);
+static DEFINE_PER_CPU(int, rcu_nocb_defer_wakeup);
+
+/* The flavors whose callbacks the kthreads handle. */
+static struct rcu_state *const rcu_nocb_flavors[] = {
+	&rcu_sched_state,
+	&rcu_bh_state,
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	&rcu_preempt_state,
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+};
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the callback on the specified CPU's no-CBs list if that CPU
+ * is a no-CBs CPU, returning false otherwise.  Concurrent enqueuers,
+ * including an interrupt handler on this very CPU, only synchronize
+ * through the xchg() of the tail pointer.  The kthread is woken up
+ * when the list was empty; if the caller had irqs disabled, it might
+ * hold scheduler locks, so the wakeup is left to the next tick.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags)
+{
+	struct rcu_head **old_rhpp;
+	int cpu = rdp->cpu;
+
+	if (!rcu_is_nocb_cpu(cpu))
+		return false;
+
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_inc(&rdp->nocb_q_count);
+
+	if (old_rhpp == &rdp->nocb_head) {
+		if (!irqs_disabled_flags(flags))
+			wake_up(&per_cpu(rcu_nocb_wq, cpu));
+		else
+			per_cpu(rcu_nocb_defer_wakeup, cpu) = 1;
+	}
+	return true;
+}
+
+/* Does the specified CPU have a kthread wakeup pending? */
+static bool rcu_nocb_need_deferred_wakeup(int cpu)
+{
+	return per_cpu(rcu_nocb_defer_wakeup, cpu);
+}
+
+/* Do the kthread wakeup deferred by __call_rcu_nocb(), if any. */
+static void rcu_nocb_do_deferred_wakeup(int cpu)
+{
+	if (!rcu_nocb_need_deferred_wakeup(cpu))
+		return;
+	per_cpu(rcu_nocb_defer_wakeup, cpu) = 0;
+	wake_up(&per_cpu(rcu_nocb_wq, cpu));
+}
+
+/* Does any flavor have callbacks queued for the specified CPU's kthread? */
+static bool rcu_nocb_cpu_has_cbs(int cpu)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rcu_nocb_flavors); i++)
+		if (ACCESS_ONCE(per_cpu_ptr(rcu_nocb_flavors[i]->rda,
+					    cpu)->nocb_head))
+			return true;
+	return false;
+}
+
+/*
+ * Wait for a grace period of the specified flavor.  The wakeup callback
+ * goes to the normal callback list of whatever CPU we run on: queueing
+ * it on a no-CBs list could leave this very kthread waiting on itself.
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_synchronize rcu;
+
+	init_rcu_head_on_stack(&rcu.head);
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rsp, 0);
+	wait_for_completion(&rcu.completion);
+	destroy_rcu_head_on_stack(&rcu.head);
+}
+
+/*
+ * Invoke one batch of the specified flavor's callbacks: detach the whole
+ * list, wait for a grace period, then invoke the callbacks in order.
+ */
+static void rcu_nocb_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	struct rcu_head *list, *next, **tail;
+	long c;
+
+	list = ACCESS_ONCE(rdp->nocb_head);
+	if (!list)
+		return;
+
+	ACCESS_ONCE(rdp->nocb_head) = NULL;
+	tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+	c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+
+	rcu_nocb_wait_gp(rsp);
+
+	while (list) {
+		next = ACCESS_ONCE(list->next);
+		/* Wait for an enqueuer racing with the xchg() above. */
+		while (next == NULL && &list->next != tail) {
+			schedule_timeout_interruptible(1);
+			next = ACCESS_ONCE(list->next);
+		}
+		debug_rcu_head_unqueue(list);
+		local_bh_disable();
+		list->func(list);
+		local_bh_enable();
+		list = next;
+		cond_resched();
+	}
+	rdp->n_nocb_invoked += c;
+}
+
+/* Per-CPU kthread which invokes the callbacks of a no-CBs CPU. */
+static int rcu_nocb_kthread(void *arg)
+{
+	int cpu = (long)arg;
+	int i;
+
+	for (;;) {
+		wait_event_interruptible(per_cpu(rcu_nocb_wq, cpu),
+					 rcu_nocb_cpu_has_cbs(cpu));
+		for (i = 0; i < ARRAY_SIZE(rcu_nocb_flavors); i++)
+			rcu_nocb_do_batch(rcu_nocb_flavors[i],
+					  per_cpu_ptr(rcu_nocb_flavors[i]->rda,
+						      cpu));
+	}
+	return 0;
+}
+
+/*
+ * Spawn the kthreads.  By default they are kept off the no-CBs CPUs
+ * themselves; userspace may move them and change their priority.
+ */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	struct sched_param sp = { .sched_priority = rcu_nocb_kthread_prio };
+	cpumask_var_t housekeeping;
+	struct task_struct *t;
+	int cpu;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&housekeeping, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(housekeeping, cpu_possible_mask, rcu_nocb_mask);
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		t = kthread_create(rcu_nocb_kthread, (void *)(long)cpu,
+				   "rcuo/%d", cpu);
+		if (IS_ERR(t)) {
+			printk(KERN_ERR "RCU: could not spawn rcuo/%d\n", cpu);
+			continue;
+		}
+		set_cpus_allowed_ptr(t, housekeeping);
+		if (rcu_nocb_kthread_prio > 0)
+			sched_setscheduler_nocheck(t, SCHED_FIFO, &sp);
+		per_cpu(rcu_nocb_task, cpu) = t;
+		wake_up_process(t);
+	}
+	free_cpumask_var(housekeeping);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+/* Initialize the no-CBs list of the specified rcu_data structure. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_head = NULL;
+	rdp->nocb_tail = &rdp->nocb_head;
+	atomic_long_set(&rdp->nocb_q_count, 0);
+}
+
+/*
+ * Finalize the no-CBs CPU set: full dynticks CPUs are always offloaded,
+ * and the boot CPU never is, so that the kthreads' own grace-period
+ * waits always have somewhere to go.
+ */
+static void __init rcu_init_nocb(void)
+{
+	char buf[64];
+	int cpu;
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask &&
+		    zalloc_cpumask_var(&rcu_nocb_mask, GFP_NOWAIT))
+			have_rcu_nocb_mask = true;
+		if (have_rcu_nocb_mask)
+			cpumask_or(rcu_nocb_mask, rcu_nocb_mask,
+				   tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!have_rcu_nocb_mask)
+		return;
+
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, rcu_nocb_mask)) {
+		printk(KERN_INFO "\tClearing boot CPU %d from rcu_nocbs.\n",
+		       cpu);
+		cpumask_clear_cpu(cpu, rcu_nocb_mask);
+	}
+	if (cpumask_empty(rcu_nocb_mask)) {
+		have_rcu_nocb_mask = false;
+		return;
+	}
+
+	for_each_cpu(cpu, rcu_nocb_mask)
+		init_waitqueue_head(&per_cpu(rcu_nocb_wq, cpu));
+
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", buf);
+}
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags)
+{
+	return false;
+}
+
+static bool rcu_nocb_need_deferred_wakeup(int cpu)
+{
+	return false;
+}
+
+static void rcu_nocb_do_deferred_wakeup(int cpu)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
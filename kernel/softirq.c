@@ -332,6 +332,8 @@ void irq_exit(void)
 	/* Make sure that timer wheel updates are propagated */
 	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
 		tick_nohz_stop_sched_tick(0);
+	else if (!in_interrupt())
+		tick_nohz_full_update_tick();
 #endif
 	preempt_enable_no_resched();
 }
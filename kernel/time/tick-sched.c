@@ -15,12 +15,15 @@
 #include <linux/err.h>
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
+#include <linux/irq_work.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/tick.h>
 #include <linux/module.h>
+#include <linux/bootmem.h>
 
 #include <asm/irq_regs.h>
 
@@ -99,6 +102,13 @@ static ktime_t tick_init_jiffy_update(void)
 	return period;
 }
 
+#ifndef CONFIG_NO_HZ_FULL
+static inline int tick_nohz_full_timekeeper(int cpu) { return 0; }
+static inline void tick_nohz_full_tick(struct tick_sched *ts) { }
+static inline void
+tick_nohz_full_idle_enter(struct tick_sched *ts, ktime_t now) { }
+#endif
+
 /*
  * NOHZ - aka dynamic tick functionality
  */
@@ -248,6 +258,278 @@ u64 get_cpu_iowait_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: CPUs listed in nohz_full= stop the tick not only when
+ * idle but also while they run a single task. The boot CPU is never
+ * part of the set and keeps the do_timer() duty for everybody.
+ */
+bool tick_nohz_full_running;
+cpumask_var_t tick_nohz_full_mask;
+
+/*
+ * Upper bound for a tickless busy period. The residual tick keeps the
+ * scheduler statistics, the cputime accounting and the RCU quiescent
+ * state reporting of the tickless CPU going.
+ */
+#define TICK_NOHZ_FULL_MAX_DEFER	HZ
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+
+	if (!cpumask_empty(tick_nohz_full_mask))
+		tick_nohz_full_running = true;
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static int __init tick_nohz_full_init(void)
+{
+	char buf[64];
+
+	if (!tick_nohz_full_running)
+		return 0;
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	printk(KERN_INFO "NOHZ: Full dynticks CPUs: %s.\n", buf);
+	return 0;
+}
+core_initcall(tick_nohz_full_init);
+
+/*
+ * With tickless CPUs around, the CPU in charge of do_timer() keeps its
+ * tick even when idle: the tickless CPUs rely on it for jiffies and
+ * walltime updates.
+ */
+static inline int tick_nohz_full_timekeeper(int cpu)
+{
+	return tick_nohz_full_running && cpu == tick_do_timer_cpu;
+}
+
+static void tick_nohz_restart(struct tick_sched *ts, ktime_t now);
+
+/*
+ * Charge the ticks which did not fire while the tick was stopped to
+ * the current task. A task with an mm is assumed to have spent them in
+ * user mode, which is what running tickless is for.
+ */
+static void tick_nohz_full_account(struct tick_sched *ts)
+{
+	unsigned long ticks = jiffies - ts->full_jiffies;
+
+	if (ticks && ticks < LONG_MAX)
+		account_busy_ticks(current, current->mm != NULL, ticks);
+	ts->full_jiffies = jiffies;
+}
+
+/*
+ * Called from the tick handlers. A tick firing while the tick is
+ * stopped is the residual tick: it accounts itself, the ones it
+ * replaced are accounted here.
+ */
+static inline void tick_nohz_full_tick(struct tick_sched *ts)
+{
+	if (ts->full_stopped) {
+		ts->full_jiffies++;
+		tick_nohz_full_account(ts);
+	}
+}
+
+static int tick_nohz_full_can_stop(int cpu)
+{
+	if (need_resched() || local_softirq_pending())
+		return 0;
+
+	/* More than one task on the runqueue needs preemption */
+	if (!sched_can_stop_tick())
+		return 0;
+
+	/* CPU timers are checked and expired from the tick */
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return 0;
+
+	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
+	    arch_needs_cpu(cpu))
+		return 0;
+
+	return 1;
+}
+
+static void tick_nohz_full_stop_tick(struct tick_sched *ts)
+{
+	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
+	unsigned long seq, last_jiffies, delta_jiffies;
+	ktime_t last_update, expires;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	delta_jiffies = get_next_timer_interrupt(last_jiffies) - last_jiffies;
+	if ((long)delta_jiffies > TICK_NOHZ_FULL_MAX_DEFER)
+		delta_jiffies = TICK_NOHZ_FULL_MAX_DEFER;
+
+	/* Do not stop the tick, if we are only one off */
+	if (!ts->full_stopped && (long)delta_jiffies <= 1)
+		return;
+
+	expires = ktime_add_ns(last_update, tick_period.tv64 * delta_jiffies);
+
+	/* Skip reprogram of event if its not changed */
+	if (ts->full_stopped && ktime_equal(expires, dev->next_event))
+		return;
+
+	if (!ts->full_stopped) {
+		ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
+		ts->full_jiffies = last_jiffies;
+		ts->full_stopped = 1;
+		ts->full_stops++;
+	}
+
+	if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+		hrtimer_start(&ts->sched_timer, expires,
+			      HRTIMER_MODE_ABS_PINNED);
+		/* Check, if the timer was already in the past */
+		if (hrtimer_active(&ts->sched_timer))
+			return;
+	} else if (!tick_program_event(expires, 0))
+		return;
+
+	/* We are past the event already, keep ticking */
+	tick_nohz_full_account(ts);
+	ts->full_stopped = 0;
+	tick_nohz_restart(ts, ktime_get());
+}
+
+static void tick_nohz_full_restart_tick(struct tick_sched *ts, ktime_t now)
+{
+	tick_nohz_full_account(ts);
+	ts->full_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/**
+ * tick_nohz_full_update_tick - stop or restart the tick of a busy cpu
+ *
+ * Called from irq_exit() when the cpu is not idle. Stops the tick when
+ * a full dynticks cpu runs a single task and nothing else depends on
+ * the tick, brings it back when that is no longer the case.
+ */
+void tick_nohz_full_update_tick(void)
+{
+	int cpu = smp_processor_id();
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (!tick_nohz_full_cpu(cpu) || idle_cpu(cpu) || ts->inidle)
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (tick_nohz_full_can_stop(cpu))
+		tick_nohz_full_stop_tick(ts);
+	else if (ts->full_stopped)
+		tick_nohz_full_restart_tick(ts, ktime_get());
+}
+
+/*
+ * Entering idle from a tickless busy period: bring the tick back, the
+ * idle code stops it again on its own terms.
+ */
+static void tick_nohz_full_idle_enter(struct tick_sched *ts, ktime_t now)
+{
+	if (ts->full_stopped)
+		tick_nohz_full_restart_tick(ts, now);
+}
+
+/**
+ * tick_nohz_full_task_switch - account a tickless period on task switch
+ *
+ * Called from the scheduler before switching away from current, so the
+ * ticks which did not fire get charged to the task which ran.
+ */
+void tick_nohz_full_task_switch(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	if (ts->full_stopped)
+		tick_nohz_full_account(ts);
+}
+
+/*
+ * Both kick flavours only need to get the target cpu through
+ * irq_exit(), which reevaluates the tick.
+ */
+static void nohz_full_kick_work_func(struct irq_work *work)
+{
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_work_func,
+};
+
+static void nohz_full_kick_ipi(void *info)
+{
+	__get_cpu_var(tick_cpu_sched).full_kick_pending = 0;
+}
+
+static DEFINE_PER_CPU(struct call_single_data, nohz_full_kick_csd) = {
+	.func = nohz_full_kick_ipi,
+};
+
+/**
+ * tick_nohz_full_kick - reevaluate the tick of the local cpu
+ *
+ * Used when something which needs the tick, e.g. a timer wheel timer,
+ * was queued locally while the tick is stopped.
+ */
+void tick_nohz_full_kick(void)
+{
+	if (__get_cpu_var(tick_cpu_sched).full_stopped)
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+}
+
+/**
+ * tick_nohz_full_kick_cpu - reevaluate the tick of a full dynticks cpu
+ * @cpu: the cpu to kick
+ *
+ * Called by the scheduler with the runqueue lock of @cpu held when a
+ * second task is enqueued there.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu == smp_processor_id()) {
+		tick_nohz_full_kick();
+		return;
+	}
+
+	if (cmpxchg(&ts->full_kick_pending, 0, 1))
+		return;
+
+	__smp_call_function_single(cpu, &per_cpu(nohz_full_kick_csd, cpu), 0);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_stop_sched_tick - stop the idle tick from the idle task
  *
@@ -286,6 +568,8 @@ void tick_nohz_stop_sched_tick(int inidle)
 
 	now = tick_nohz_start_idle(cpu, ts);
 
+	tick_nohz_full_idle_enter(ts, now);
+
 	/*
 	 * If this cpu is offline and it is the one which updates
 	 * jiffies, then give up the assignment and let it be taken by
@@ -325,7 +609,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	} while (read_seqretry(&xtime_lock, seq));
 
 	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
-	    arch_needs_cpu(cpu)) {
+	    arch_needs_cpu(cpu) || tick_nohz_full_timekeeper(cpu)) {
 		next_jiffies = last_jiffies + 1;
 		delta_jiffies = 1;
 	} else {
@@ -578,7 +862,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -597,6 +882,7 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 		touch_softlockup_watchdog();
 		ts->idle_jiffies++;
 	}
+	tick_nohz_full_tick(ts);
 
 	update_process_times(user_mode(regs));
 	profile_tick(CPU_PROFILING);
@@ -732,7 +1018,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -757,6 +1044,7 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
+		tick_nohz_full_tick(ts);
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 	}
@@ -701,8 +701,15 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	timer->expires = expires;
 	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
+	    !tbase_get_deferrable(timer->base)) {
 		base->next_timer = timer->expires;
+		/*
+		 * A tickless busy cpu programmed its next event from
+		 * the old next_timer, have it look again.
+		 */
+		if (base == per_cpu(tvec_bases, smp_processor_id()))
+			tick_nohz_full_kick();
+	}
 	internal_add_timer(base, timer);
 
 out_unlock:
@@ -876,6 +883,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * the timer wheel.
 	 */
 	wake_up_idle_cpu(cpu);
+	tick_nohz_full_kick_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -33,26 +33,6 @@
 #include <linux/rcupdate.h>
 
 
-#ifdef __KERNEL__
-#define RADIX_TREE_MAP_SHIFT	(CONFIG_BASE_SMALL ? 4 : 6)
-#else
-#define RADIX_TREE_MAP_SHIFT	3	/* For more stressful testing */
-#endif
-
-#define RADIX_TREE_MAP_SIZE	(1UL << RADIX_TREE_MAP_SHIFT)
-#define RADIX_TREE_MAP_MASK	(RADIX_TREE_MAP_SIZE-1)
-
-#define RADIX_TREE_TAG_LONGS	\
-	((RADIX_TREE_MAP_SIZE + BITS_PER_LONG - 1) / BITS_PER_LONG)
-
-struct radix_tree_node {
-	unsigned int	height;		/* Height from the bottom */
-	unsigned int	count;
-	struct rcu_head	rcu_head;
-	void __rcu	*slots[RADIX_TREE_MAP_SIZE];
-	unsigned long	tags[RADIX_TREE_MAX_TAGS][RADIX_TREE_TAG_LONGS];
-};
-
 struct radix_tree_path {
 	struct radix_tree_node *node;
 	int offset;
@@ -285,7 +265,11 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 
 		newheight = root->height+1;
 		node->height = newheight;
-		node->count = 1;
+		if (newheight == 1 &&
+		    radix_tree_exceptional_entry(node->slots[0]))
+			node->count = 1U << RADIX_TREE_COUNT_SHIFT;
+		else
+			node->count = 1;
 		node = ptr_to_indirect(node);
 		rcu_assign_pointer(root->rnode, node);
 		root->height = newheight;
@@ -405,6 +389,66 @@ static void *radix_tree_lookup_element(struct radix_tree_root *root,
 	return is_slot ? (void *)slot : indirect_to_ptr(node);
 }
 
+/**
+ *	__radix_tree_lookup	-	lookup an item in a radix tree
+ *	@root:		radix tree root
+ *	@index:		index key
+ *	@nodep:		returns the node holding the slot, or NULL
+ *	@slotp:		returns the slot
+ *
+ *	Lookup and return the item at position @index in the radix tree
+ *	@root.  @nodep and @slotp, if not NULL, are set only when an item
+ *	is found.  *@nodep is NULL if the item is stored directly in
+ *	@root->rnode, which is the case as long as the tree has only one
+ *	item at index 0.
+ *
+ *	The caller must hold the tree write locked.
+ */
+void *__radix_tree_lookup(struct radix_tree_root *root, unsigned long index,
+			  struct radix_tree_node **nodep, void ***slotp)
+{
+	struct radix_tree_node *node, *parent;
+	unsigned int height, shift;
+	void **slot;
+
+	node = rcu_dereference_raw(root->rnode);
+	if (node == NULL)
+		return NULL;
+
+	if (!radix_tree_is_indirect_ptr(node)) {
+		if (index > 0)
+			return NULL;
+		parent = NULL;
+		slot = (void **)&root->rnode;
+		goto found;
+	}
+	node = indirect_to_ptr(node);
+
+	height = node->height;
+	if (index > radix_tree_maxindex(height))
+		return NULL;
+
+	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+
+	do {
+		parent = node;
+		slot = (void **)(node->slots + ((index>>shift) & RADIX_TREE_MAP_MASK));
+		node = rcu_dereference_raw(*slot);
+		if (node == NULL)
+			return NULL;
+
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	} while (height > 0);
+found:
+	if (nodep)
+		*nodep = parent;
+	if (slotp)
+		*slotp = slot;
+	return node;
+}
+EXPORT_SYMBOL(__radix_tree_lookup);
+
 /**
  *	radix_tree_lookup_slot    -    lookup a slot in a radix tree
  *	@root:		radix tree root
@@ -823,8 +867,8 @@ unsigned long radix_tree_prev_hole(struct radix_tree_root *root,
 EXPORT_SYMBOL(radix_tree_prev_hole);
 
 static unsigned int
-__lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
-	unsigned int max_items, unsigned long *next_index)
+__lookup(struct radix_tree_node *slot, void ***results, unsigned long *indices,
+	unsigned long index, unsigned int max_items, unsigned long *next_index)
 {
 	unsigned int nr_found = 0;
 	unsigned int shift, height;
@@ -857,12 +901,16 @@ __lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
 
 	/* Bottom level: grab some items */
 	for (i = index & RADIX_TREE_MAP_MASK; i < RADIX_TREE_MAP_SIZE; i++) {
-		index++;
 		if (slot->slots[i]) {
-			results[nr_found++] = &(slot->slots[i]);
-			if (nr_found == max_items)
+			results[nr_found] = &(slot->slots[i]);
+			if (indices)
+				indices[nr_found] = index;
+			if (++nr_found == max_items) {
+				index++;
 				goto out;
+			}
 		}
+		index++;
 	}
 out:
 	*next_index = index;
@@ -918,8 +966,8 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 
 		if (cur_index > max_index)
 			break;
-		slots_found = __lookup(node, (void ***)results + ret, cur_index,
-					max_items - ret, &next_index);
+		slots_found = __lookup(node, (void ***)results + ret, NULL,
+					cur_index, max_items - ret, &next_index);
 		nr_found = 0;
 		for (i = 0; i < slots_found; i++) {
 			struct radix_tree_node *slot;
@@ -944,6 +992,7 @@ EXPORT_SYMBOL(radix_tree_gang_lookup);
  *	radix_tree_gang_lookup_slot - perform multiple slot lookup on radix tree
  *	@root:		radix tree root
  *	@results:	where the results of the lookup are placed
+ *	@indices:	where their indices should be placed (but usually NULL)
  *	@first_index:	start the lookup from this key
  *	@max_items:	place up to this many items at *results
  *
@@ -959,7 +1008,8 @@ EXPORT_SYMBOL(radix_tree_gang_lookup);
  */
 unsigned int
 radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
-			unsigned long first_index, unsigned int max_items)
+			unsigned long *indices, unsigned long first_index,
+			unsigned int max_items)
 {
 	unsigned long max_index;
 	struct radix_tree_node *node;
@@ -974,6 +1024,8 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 		if (first_index > 0)
 			return 0;
 		results[0] = (void **)&root->rnode;
+		if (indices)
+			indices[0] = 0;
 		return 1;
 	}
 	node = indirect_to_ptr(node);
@@ -987,8 +1039,9 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 
 		if (cur_index > max_index)
 			break;
-		slots_found = __lookup(node, results + ret, cur_index,
-					max_items - ret, &next_index);
+		slots_found = __lookup(node, results + ret,
+				indices ? indices + ret : NULL,
+				cur_index, max_items - ret, &next_index);
 		ret += slots_found;
 		if (next_index == 0)
 			break;
@@ -1257,6 +1310,42 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 	}
 }
 
+/*
+ * Clear the slots along @pathp, from the bottom up, and free the nodes
+ * that are left without any slots in use, starting with @to_free.
+ */
+static void radix_tree_free_nodes(struct radix_tree_root *root,
+				  struct radix_tree_path *pathp,
+				  struct radix_tree_node *to_free)
+{
+	while (pathp->node) {
+		pathp->node->slots[pathp->offset] = NULL;
+		pathp->node->count--;
+		/*
+		 * Queue the node for deferred freeing after the
+		 * last reference to it disappears (set NULL, above).
+		 */
+		if (to_free)
+			radix_tree_node_free(to_free);
+
+		if (pathp->node->count) {
+			if (pathp->node == indirect_to_ptr(root->rnode))
+				radix_tree_shrink(root);
+			return;
+		}
+
+		/* Node with zero slots in use so free it */
+		to_free = pathp->node;
+		pathp--;
+
+	}
+	root_tag_clear_all(root);
+	root->height = 0;
+	root->rnode = NULL;
+	if (to_free)
+		radix_tree_node_free(to_free);
+}
+
 /**
  *	radix_tree_delete    -    delete an item from a radix tree
  *	@root:		radix tree root
@@ -1274,7 +1363,6 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	 */
 	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
 	struct radix_tree_node *slot = NULL;
-	struct radix_tree_node *to_free;
 	unsigned int height, shift;
 	int tag;
 	int offset;
@@ -1318,39 +1406,61 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 			radix_tree_tag_clear(root, index, tag);
 	}
 
-	to_free = NULL;
 	/* Now free the nodes we do not need anymore */
-	while (pathp->node) {
-		pathp->node->slots[pathp->offset] = NULL;
-		pathp->node->count--;
-		/*
-		 * Queue the node for deferred freeing after the
-		 * last reference to it disappears (set NULL, above).
-		 */
-		if (to_free)
-			radix_tree_node_free(to_free);
+	radix_tree_free_nodes(root, pathp, NULL);
+out:
+	return slot;
+}
+EXPORT_SYMBOL(radix_tree_delete);
 
-		if (pathp->node->count) {
-			if (pathp->node == indirect_to_ptr(root->rnode))
-				radix_tree_shrink(root);
-			goto out;
+/**
+ *	__radix_tree_delete_node    -    try to free a node after clearing slots
+ *	@root:		radix tree root
+ *	@index:		index key of any slot in @node
+ *	@node:		node to free
+ *
+ *	After clearing slots of @node with radix_tree_replace_slot() and
+ *	adjusting @node->count to match, call this to free @node if it has
+ *	no slots in use anymore and to shrink the tree where possible.
+ *
+ *	Returns %true if @node was freed, %false otherwise.
+ */
+bool __radix_tree_delete_node(struct radix_tree_root *root,
+			      unsigned long index,
+			      struct radix_tree_node *node)
+{
+	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
+	struct radix_tree_node *slot;
+	unsigned int height, shift;
+
+	if (node->count) {
+		if (node == indirect_to_ptr(root->rnode)) {
+			radix_tree_shrink(root);
+			return root->rnode != ptr_to_indirect(node);
 		}
+		return false;
+	}
 
-		/* Node with zero slots in use so free it */
-		to_free = pathp->node;
-		pathp--;
+	/* Record the path from the root down to the parent of @node */
+	height = root->height;
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	slot = indirect_to_ptr(root->rnode);
+	pathp->node = NULL;
 
+	while (height > node->height) {
+		pathp++;
+		pathp->offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		pathp->node = slot;
+		slot = slot->slots[pathp->offset];
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
 	}
-	root_tag_clear_all(root);
-	root->height = 0;
-	root->rnode = NULL;
-	if (to_free)
-		radix_tree_node_free(to_free);
+	BUG_ON(slot != node);
 
-out:
-	return slot;
+	radix_tree_free_nodes(root, pathp, node);
+	return true;
 }
-EXPORT_SYMBOL(radix_tree_delete);
+EXPORT_SYMBOL(__radix_tree_delete_node);
 
 /**
  *	radix_tree_tagged - test whether any items in the tree are tagged
@@ -1366,7 +1476,10 @@ EXPORT_SYMBOL(radix_tree_tagged);
 static void
 radix_tree_node_ctor(void *node)
 {
-	memset(node, 0, sizeof(struct radix_tree_node));
+	struct radix_tree_node *n = node;
+
+	memset(n, 0, sizeof(*n));
+	INIT_LIST_HEAD(&n->private_list);
 }
 
 static __init unsigned long __maxindex(unsigned int height)
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -31,6 +33,7 @@ struct compact_control {
 	struct list_head migratepages;	/* List of pages being migrated */
 	unsigned long nr_freepages;	/* Number of isolated free pages */
 	unsigned long nr_migratepages;	/* Number of pages to migrate */
+	unsigned long nr_migrated;	/* Number of pages migrated so far */
 	unsigned long free_pfn;		/* isolate_freepages search base */
 	unsigned long migrate_pfn;	/* isolate_migratepages search base */
 	bool sync;			/* Synchronous migration */
@@ -397,7 +400,7 @@ static int compact_finished(struct zone *zone,
 		return COMPACT_COMPLETE;
 
 	/* Compaction run is not finished if the watermark is not met */
-	if (cc->compact_mode != COMPACT_MODE_KSWAPD)
+	if (cc->compact_mode == COMPACT_MODE_DIRECT_RECLAIM)
 		watermark = low_wmark_pages(zone);
 	else
 		watermark = high_wmark_pages(zone);
@@ -406,6 +409,10 @@ static int compact_finished(struct zone *zone,
 	if (!zone_watermark_ok(zone, cc->order, watermark, 0, 0))
 		return COMPACT_CONTINUE;
 
+	/* kcompactd: the zone has reached its target */
+	if (cc->compact_mode == COMPACT_MODE_KCOMPACTD)
+		return COMPACT_PARTIAL;
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -519,6 +526,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		update_nr_listpages(cc);
 		nr_remaining = cc->nr_migratepages;
 
+		cc->nr_migrated += nr_migrate - nr_remaining;
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
 		if (nr_remaining)
@@ -583,6 +591,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
+	unsigned long start;
 
 	/*
 	 * Check whether it is worth even starting compaction. The order check is
@@ -593,6 +602,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		return rc;
 
 	count_vm_event(COMPACTSTALL);
+	start = jiffies;
 
 	/* Compact each zone in the list */
 	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
@@ -608,6 +618,8 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	count_vm_events(COMPACTSTALL_TIME_MS, jiffies_to_msecs(jiffies - start));
+
 	return rc;
 }
 
@@ -683,6 +695,227 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * How often kcompactd wakes up on its own to compact towards the high
+ * watermark for pageblock_order allocations. 0 disables these periodic
+ * runs; kcompactd is then only woken by kswapd and direct compaction.
+ */
+int sysctl_kcompactd_sleep_millisecs = 500;
+
+/**
+ * wakeup_kcompactd - ask a node's kcompactd to compact in the background
+ * @pgdat: node to compact
+ * @order: order of the allocation which could not be satisfied
+ * @classzone_idx: highest zone the allocation may use
+ *
+ * Requests are merged: kcompactd compacts for the largest order and
+ * the lowest classzone of all wakeups since it last ran.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	unsigned long start = jiffies;
+	unsigned long nr_migrated = 0;
+	int zoneid;
+
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+			.sync = false,
+			.compact_mode = COMPACT_MODE_KCOMPACTD,
+		};
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone))
+			continue;
+
+		/* Nothing to do if the zone is already where we want it */
+		if (zone_watermark_ok(zone, order, high_wmark_pages(zone), 0, 0))
+			continue;
+
+		/*
+		 * compaction_suitable() also consults the fragmentation index,
+		 * so a zone short of free memory rather than of contiguous
+		 * free memory is left to kswapd.
+		 */
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		if (kthread_should_stop())
+			break;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+		nr_migrated += cc.nr_migrated;
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else if (status == COMPACT_COMPLETE) {
+			/* A full pass did not help, back off like direct compaction */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	count_vm_events(KCOMPACTD_MIGRATED, nr_migrated);
+	count_vm_events(KCOMPACTD_TIME_MS, jiffies_to_msecs(jiffies - start));
+}
+
+static long kcompactd_timeout(void)
+{
+	int msecs = sysctl_kcompactd_sleep_millisecs;
+
+	return msecs ? msecs_to_jiffies(msecs) : MAX_SCHEDULE_TIMEOUT;
+}
+
+/*
+ * The background compaction daemon, one per node. It is woken when kswapd
+ * goes to sleep after reclaiming for a high-order allocation and when
+ * direct compaction is deferred, and it also checks the node periodically
+ * so that high-order pages are available before anyone has to stall.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		int order, classzone_idx;
+		long ret;
+
+		ret = wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				pgdat->kcompactd_max_order ||
+				kthread_should_stop(),
+				kcompactd_timeout());
+		if (kthread_should_stop())
+			break;
+
+		order = pgdat->kcompactd_max_order;
+		classzone_idx = pgdat->kcompactd_classzone_idx;
+		pgdat->kcompactd_max_order = 0;
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+		if (!order) {
+			/* Woken by the timeout: proactive compaction */
+			if (ret || !sysctl_kcompactd_sleep_millisecs)
+				continue;
+			order = pageblock_order;
+		}
+
+		kcompactd_do_work(pgdat, order, classzone_idx);
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+int sysctl_kcompactd_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	/*
+	 * Kick off a proactive run now; the daemons rearm their timers with
+	 * the new interval once they are done.
+	 */
+	if (sysctl_kcompactd_sleep_millisecs) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+
+			wakeup_kcompactd(pgdat, pageblock_order,
+					 pgdat->nr_zones - 1);
+		}
+	}
+
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -107,16 +107,66 @@
  *    ->i_mmap_lock
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	struct radix_tree_node *node;
+	void **slot;
+	int tag;
+
+	/*
+	 * Only clean pages are replaced by shadows, but a stale
+	 * towrite tag may still be around: drop all the tags that
+	 * radix_tree_delete() would have cleared.
+	 */
+	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+		radix_tree_tag_clear(&mapping->page_tree, page->index, tag);
+
+	__radix_tree_lookup(&mapping->page_tree, page->index, &node, &slot);
+	radix_tree_replace_slot(slot, shadow);
+
+	if (shadow) {
+		mapping->nrshadows++;
+		/*
+		 * Make sure the nrshadows update is committed before the
+		 * nrpages update, so that a final truncate racing with
+		 * reclaim does not see both counters 0 at the same time
+		 * and miss a shadow entry.
+		 */
+		smp_wmb();
+	}
+
+	if (!node)
+		return;
+
+	workingset_node_pages_dec(node);
+	if (shadow)
+		workingset_node_shadows_inc(node);
+	else if (__radix_tree_delete_node(&mapping->page_tree,
+					  page->index, node))
+		return;
+
+	/*
+	 * A node with only shadow entries left is reclaimable by
+	 * the shadow node shrinker: see mm/workingset.c.
+	 */
+	if (!workingset_node_pages(node))
+		workingset_remember_node(mapping, page->index, node);
+}
+
 /*
  * Remove a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
  * is safe.  The caller must hold the mapping's tree_lock.
+ *
+ * If @shadow is not NULL, it is left behind in the page's slot so that
+ * a refault of the page can be recognized: see mm/workingset.c.
  */
-void __remove_from_page_cache(struct page *page)
+void __remove_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -146,7 +196,7 @@ void remove_from_page_cache(struct page *page)
 
 	freepage = mapping->a_ops->freepage;
 	spin_lock_irq(&mapping->tree_lock);
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -386,18 +436,44 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 }
 EXPORT_SYMBOL(filemap_write_and_wait_range);
 
-/**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
- */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+static int page_cache_tree_insert(struct address_space *mapping,
+				  struct page *page, void **shadowp)
+{
+	struct radix_tree_node *node;
+	void **slot;
+	void *p;
+	int error;
+
+	p = __radix_tree_lookup(&mapping->page_tree, page->index, &node, &slot);
+	if (!p) {
+		error = radix_tree_insert(&mapping->page_tree, page->index, page);
+		if (error || !mapping->nrshadows)
+			return error;
+		/* The page may have gone into a node of only shadows */
+		__radix_tree_lookup(&mapping->page_tree, page->index, &node, NULL);
+	} else {
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+
+		/* Take the place of the shadow entry of an evicted page */
+		radix_tree_replace_slot(slot, page);
+		mapping->nrshadows--;
+		if (shadowp)
+			*shadowp = p;
+		if (node) {
+			workingset_node_shadows_dec(node);
+			workingset_node_pages_inc(node);
+		}
+	}
+	if (node)
+		workingset_forget_node(node);
+	return 0;
+}
+
+static int __add_to_page_cache_locked(struct page *page,
+				      struct address_space *mapping,
+				      pgoff_t offset, gfp_t gfp_mask,
+				      void **shadowp)
 {
 	int error;
 
@@ -415,7 +491,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -434,11 +510,29 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -450,14 +544,30 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
-	return ret;
+
+	if (!page_is_file_cache(page)) {
+		lru_cache_add_anon(page);
+		return 0;
+	}
+
+	/*
+	 * A page that was evicted recently enough to have been kept by
+	 * a bigger inactive list is part of the working set: activate
+	 * it right away instead of letting it thrash again.
+	 */
+	if (shadow && workingset_refault(shadow)) {
+		workingset_activation(page);
+		lru_cache_add_lru(page, LRU_ACTIVE_FILE);
+	} else
+		lru_cache_add_file(page);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
@@ -627,6 +737,64 @@ int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 	}
 }
 
+/**
+ * page_cache_next_hole - find the next hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_next_hole(), except that the shadow entries of
+ * evicted pages are holes too.  May be called under rcu_read_lock.
+ */
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index++;
+		if (index == 0)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_next_hole);
+
+/**
+ * page_cache_prev_hole - find the prev hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_prev_hole(), except that the shadow entries of
+ * evicted pages are holes too.  May be called under rcu_read_lock.
+ */
+pgoff_t page_cache_prev_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index--;
+		if (index == ULONG_MAX)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_prev_hole);
+
 /**
  * find_get_page - find and get a page reference
  * @mapping: the address_space to search
@@ -648,8 +816,13 @@ repeat:
 		page = radix_tree_deref_slot(pagep);
 		if (unlikely(!page))
 			goto out;
-		if (radix_tree_deref_retry(page))
-			goto repeat;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page))
+				goto repeat;
+			/* A shadow entry: the page is not in memory */
+			page = NULL;
+			goto out;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -767,38 +940,60 @@ EXPORT_SYMBOL(find_or_create_page);
 unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 			    unsigned int nr_pages, struct page **pages)
 {
+	unsigned long indices[PAGEVEC_SIZE];
 	unsigned int i;
 	unsigned int ret;
+	unsigned int base;
 	unsigned int nr_found;
 
 	rcu_read_lock();
-restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
 	ret = 0;
-	for (i = 0; i < nr_found; i++) {
-		struct page *page;
+	while (ret < nr_pages) {
+		/*
+		 * Look the slots up in batches, so that we know where to
+		 * continue even when all we found were shadow entries.
+		 */
+restart:
+		base = ret;
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+				(void ***)pages + base, indices, start,
+				min_t(unsigned int, nr_pages - base,
+				      PAGEVEC_SIZE));
+		if (!nr_found)
+			break;
+
+		for (i = 0; i < nr_found; i++) {
+			void **slot = (void **)pages[base + i];
+			struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
-		if (unlikely(!page))
-			continue;
-		if (radix_tree_deref_retry(page)) {
-			if (ret)
-				start = pages[ret-1]->index;
-			goto restart;
-		}
+			page = radix_tree_deref_slot(slot);
+			if (unlikely(!page))
+				continue;
+			if (radix_tree_exception(page)) {
+				if (radix_tree_deref_retry(page)) {
+					start = indices[i];
+					goto restart;
+				}
+				/* A shadow entry: skip over it */
+				continue;
+			}
 
-		if (!page_cache_get_speculative(page))
-			goto repeat;
+			if (!page_cache_get_speculative(page))
+				goto repeat;
 
-		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
-			page_cache_release(page);
-			goto repeat;
+			/* Has the page moved? */
+			if (unlikely(page != *slot)) {
+				page_cache_release(page);
+				goto repeat;
+			}
+
+			pages[ret] = page;
+			ret++;
 		}
 
-		pages[ret] = page;
-		ret++;
+		start = indices[nr_found - 1] + 1;
+		if (!start)
+			break;		/* wrapped around */
 	}
 	rcu_read_unlock();
 	return ret;
@@ -826,7 +1021,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
+				(void ***)pages, NULL, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -834,8 +1029,12 @@ repeat:
 		page = radix_tree_deref_slot((void **)pages[i]);
 		if (unlikely(!page))
 			continue;
-		if (radix_tree_deref_retry(page))
-			goto restart;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page))
+				goto restart;
+			/* A shadow entry is a hole in the cached range */
+			break;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -1491,6 +1690,7 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 	 */
 	ra_pages = max_sane_readahead(ra->ra_pages);
 	if (ra_pages) {
+		ra->stride = 0;
 		ra->start = max_t(long, 0, offset - ra_pages/2);
 		ra->size = ra_pages;
 		ra->async_size = 0;
@@ -1653,8 +1853,88 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map the cached pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	range of offsets to map, and the pte of vmf->pgoff
+ *
+ * Maps the pages from vmf->pgoff to vmf->max_pgoff that are uptodate
+ * in the page cache and can be locked without waiting.  The page table
+ * lock is held, so nothing here may sleep: pages which are not ready
+ * are left for filemap_fault() to deal with.
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	unsigned long address = (unsigned long)vmf->virtual_address;
+	struct page *pages[PAGEVEC_SIZE];
+	pgoff_t index = vmf->pgoff;
+	pgoff_t end_index;
+	unsigned int i, nr;
+	loff_t size;
+
+	size = i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1;
+	end_index = size >> PAGE_CACHE_SHIFT;
+
+	while (index <= vmf->max_pgoff) {
+		pgoff_t start = index;
+
+		nr = find_get_pages(mapping, index,
+				    min_t(pgoff_t, PAGEVEC_SIZE,
+					  vmf->max_pgoff - index + 1),
+				    pages);
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+			pgoff_t page_index = page->index;
+			unsigned long addr;
+			pte_t *pte;
+
+			if (page_index >= index)
+				index = page_index + 1;
+
+			if (!PageUptodate(page) || PageReadahead(page) ||
+			    PageHWPoison(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+
+			/* The page may have been truncated and reused */
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+			if (page->index < vmf->pgoff ||
+			    page->index > vmf->max_pgoff ||
+			    page->index >= end_index)
+				goto unlock;
+
+			pte = vmf->pte + page->index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (file->f_ra.mmap_miss > 0)
+				file->f_ra.mmap_miss--;
+			addr = address + (page->index - vmf->pgoff) * PAGE_SIZE;
+			/* The mapping takes over our page reference */
+			do_set_pte(vma, addr, page, pte, false, false);
+			unlock_page(page);
+			continue;
+unlock:
+			unlock_page(page);
+skip:
+			page_cache_release(page);
+		}
+		if (index == start)
+			break;
+	}
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
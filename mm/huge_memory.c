@@ -17,6 +17,8 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/shmem_fs.h>
+#include <linux/file.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -312,6 +314,9 @@ static struct attribute *hugepage_attr[] = {
 	&defrag_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -664,13 +669,39 @@ static inline struct page *alloc_hugepage(int defrag)
 }
 #endif
 
+/* Handle a fault which could not be given a huge pmd */
+static int huge_pmd_fallback(struct mm_struct *mm, struct vm_area_struct *vma,
+			     unsigned long address, pmd_t *pmd,
+			     unsigned int flags)
+{
+	pte_t *pte;
+
+	/*
+	 * Use __pte_alloc instead of pte_alloc_map, because we can't
+	 * run pte_offset_map on the pmd, if an huge pmd could
+	 * materialize from under us from a different thread.
+	 */
+	if (unlikely(__pte_alloc(mm, vma, pmd, address)))
+		return VM_FAULT_OOM;
+	/* if an huge pmd materialized from under us just retry later */
+	if (unlikely(pmd_trans_huge(*pmd)))
+		return 0;
+	/*
+	 * A regular pmd is established and it can't morph into a huge pmd
+	 * from under us anymore at this point because we hold the mmap_sem
+	 * read mode and khugepaged takes it in write mode. So now it's
+	 * safe to run pte_offset_map().
+	 */
+	pte = pte_offset_map(pmd, address);
+	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
+}
+
 int do_huge_pmd_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			       unsigned long address, pmd_t *pmd,
 			       unsigned int flags)
 {
 	struct page *page;
 	unsigned long haddr = address & HPAGE_PMD_MASK;
-	pte_t *pte;
 
 	if (haddr >= vma->vm_start && haddr + HPAGE_PMD_SIZE <= vma->vm_end) {
 		if (unlikely(anon_vma_prepare(vma)))
@@ -689,25 +720,171 @@ int do_huge_pmd_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		return __do_huge_pmd_anonymous_page(mm, vma, haddr, pmd, page);
 	}
 out:
-	/*
-	 * Use __pte_alloc instead of pte_alloc_map, because we can't
-	 * run pte_offset_map on the pmd, if an huge pmd could
-	 * materialize from under us from a different thread.
-	 */
-	if (unlikely(__pte_alloc(mm, vma, pmd, address)))
+	return huge_pmd_fallback(mm, vma, address, pmd, flags);
+}
+
+#ifdef CONFIG_SHMEM
+/*
+ * A complete shmem extent (see shmem_huge_extent) is mapped by a huge
+ * pmd although its pages are not a compound page: each of them is
+ * referenced and accounted in the rmap as if it was mapped by a pte,
+ * and is dirtied up front in a writable mapping so that the dirty bit
+ * of the pmd does not matter.  No page table is deposited; splitting
+ * such a pmd just unmaps it, and the next faults map single pages.
+ */
+int do_huge_pmd_shmem_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			   unsigned long address, pmd_t *pmd,
+			   unsigned int flags)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	pmd_t entry;
+	int i, mapped = 0;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		goto out;
+	if (linear_page_index(vma, haddr) & (HPAGE_PMD_NR - 1))
+		goto out;
+	if (unlikely(!test_bit(MMF_VM_HUGEPAGE, &mm->flags) &&
+		     __khugepaged_enter(mm)))
 		return VM_FAULT_OOM;
-	/* if an huge pmd materialized from under us just retry later */
-	if (unlikely(pmd_trans_huge(*pmd)))
+
+	page = shmem_huge_extent(vma, linear_page_index(vma, haddr));
+	if (!page)
+		goto out;
+
+	entry = mk_pmd(page, vma->vm_page_prot);
+	if (vma->vm_flags & VM_WRITE) {
+		entry = pmd_mkwrite(pmd_mkdirty(entry));
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			set_page_dirty(page + i);
+	}
+	entry = pmd_mkhuge(entry);
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_none(*pmd))) {
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			page_add_file_rmap(page + i);
+		set_pmd_at(mm, haddr, pmd, entry);
+		add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+		mapped = 1;
+	}
+	spin_unlock(&mm->page_table_lock);
+
+	/* the mapping keeps the references of the extent lookup */
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		unlock_page(page + i);
+		if (!mapped)
+			page_cache_release(page + i);
+	}
+	return 0;
+out:
+	return huge_pmd_fallback(mm, vma, address, pmd, flags);
+}
+
+/* Unmap a shmem pmd: the pages are left for the ptes to map */
+static void __split_shmem_pmd(struct mm_struct *mm, unsigned long haddr,
+			      pmd_t *pmd)
+{
+	struct page *page = NULL;
+	pmd_t _pmd;
+	int i;
+
+	mmu_notifier_invalidate_range_start(mm, haddr, haddr + HPAGE_PMD_SIZE);
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd))) {
+		_pmd = pmdp_get_and_clear(mm, haddr, pmd);
+		flush_tlb_mm(mm);
+		page = pmd_page(_pmd);
+		VM_BUG_ON(PageCompound(page));
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			page_remove_rmap(page + i);
+		add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+	}
+	spin_unlock(&mm->page_table_lock);
+	mmu_notifier_invalidate_range_end(mm, haddr, haddr + HPAGE_PMD_SIZE);
+
+	if (page)
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			page_cache_release(page + i);
+}
+
+static pmd_t *shmem_pmd_lookup(struct mm_struct *mm, unsigned long haddr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, haddr);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, haddr);
+	if (!pud_present(*pud))
+		return NULL;
+	return pmd_offset(pud, haddr);
+}
+
+/*
+ * page_check_address() does not see pages mapped by huge pmds: these
+ * tell the rmap walkers about a shmem page which is.  Only the first
+ * page of the extent ages the pmd, the others just report it young, so
+ * that one reference keeps the whole extent on the active list.
+ * Returns -1 if @page is not mapped by a huge pmd at @address.
+ */
+int shmem_pmd_clear_flush_young(struct page *page, struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pmd_t *pmd;
+	int ret = -1;
+
+	if (!(vma->vm_flags & VM_SHARED) || !vma_is_shmem(vma))
+		return -1;
+	pmd = shmem_pmd_lookup(mm, haddr);
+	if (!pmd)
+		return -1;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) &&
+	    pmd_page(*pmd) + ((address - haddr) >> PAGE_SHIFT) == page) {
+		if (page == pmd_page(*pmd))
+			ret = pmdp_clear_flush_young_notify(vma, haddr, pmd);
+		else
+			ret = !!pmd_young(*pmd);
+	}
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/*
+ * Split the huge pmd mapping @page at @address, if there is one, so that
+ * the page can be unmapped.  Returns 1 if it did.
+ */
+int shmem_pmd_unmap(struct page *page, struct vm_area_struct *vma,
+		    unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pmd_t *pmd;
+	int found = 0;
+
+	if (!(vma->vm_flags & VM_SHARED) || !vma_is_shmem(vma))
 		return 0;
-	/*
-	 * A regular pmd is established and it can't morph into a huge pmd
-	 * from under us anymore at this point because we hold the mmap_sem
-	 * read mode and khugepaged takes it in write mode. So now it's
-	 * safe to run pte_offset_map().
-	 */
-	pte = pte_offset_map(pmd, address);
-	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
+	pmd = shmem_pmd_lookup(mm, haddr);
+	if (!pmd)
+		return 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) &&
+	    pmd_page(*pmd) + ((address - haddr) >> PAGE_SHIFT) == page)
+		found = 1;
+	spin_unlock(&mm->page_table_lock);
+
+	if (found)
+		__split_shmem_pmd(mm, haddr, pmd);
+	return found;
 }
+#endif /* CONFIG_SHMEM */
 
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
@@ -742,7 +919,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
-	VM_BUG_ON(!PageHead(src_page));
+	if (!PageHead(src_page)) {
+		/* a shmem pmd: the child faults the extent in again */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	get_page(src_page);
 	page_dup_rmap(src_page);
 	add_mm_counter(dst_mm, MM_ANONPAGES, HPAGE_PMD_NR);
@@ -961,7 +1143,8 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	/* shmem extents are mapped without being compound pages */
+	VM_BUG_ON(PageTail(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -976,7 +1159,6 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
 	if (flags & FOLL_GET)
 		get_page(page);
 
@@ -995,6 +1177,19 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			spin_unlock(&tlb->mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma,
 					     pmd);
+		} else if (!PageHead(pmd_page(*pmd))) {
+			struct page *page = pmd_page(*pmd);
+			int i;
+
+			/* a shmem extent, see do_huge_pmd_shmem_page() */
+			pmd_clear(pmd);
+			for (i = 0; i < HPAGE_PMD_NR; i++)
+				page_remove_rmap(page + i);
+			add_mm_counter(tlb->mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+			spin_unlock(&tlb->mm->page_table_lock);
+			for (i = 0; i < HPAGE_PMD_NR; i++)
+				tlb_remove_page(tlb, page + i);
+			ret = 1;
 		} else {
 			struct page *page;
 			pgtable_t pgtable;
@@ -1052,6 +1247,10 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 		if (unlikely(pmd_trans_splitting(*pmd))) {
 			spin_unlock(&mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma, pmd);
+		} else if (!PageHead(pmd_page(*pmd))) {
+			/* shmem pmds are just unmapped, to be refaulted */
+			spin_unlock(&mm->page_table_lock);
+			__split_huge_page_pmd(mm, addr, pmd);
 		} else {
 			pmd_t entry;
 
@@ -1405,11 +1604,13 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		 * Be somewhat over-protective like KSM for now!
 		 */
 		if (*vm_flags & (VM_HUGEPAGE |
-				 VM_SHARED   | VM_MAYSHARE   |
 				 VM_PFNMAP   | VM_IO      | VM_DONTEXPAND |
 				 VM_RESERVED | VM_HUGETLB | VM_INSERTPAGE |
 				 VM_MIXEDMAP | VM_SAO))
 			return -EINVAL;
+		/* shared mappings only of shmem, see shmem_huge_enabled() */
+		if (*vm_flags & (VM_SHARED | VM_MAYSHARE) && !vma_is_shmem(vma))
+			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
 		/*
@@ -1425,11 +1626,13 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		 * Be somewhat over-protective like KSM for now!
 		 */
 		if (*vm_flags & (VM_NOHUGEPAGE |
-				 VM_SHARED   | VM_MAYSHARE   |
 				 VM_PFNMAP   | VM_IO      | VM_DONTEXPAND |
 				 VM_RESERVED | VM_HUGETLB | VM_INSERTPAGE |
 				 VM_MIXEDMAP | VM_SAO))
 			return -EINVAL;
+		/* shared mappings only of shmem, see shmem_huge_enabled() */
+		if (*vm_flags & (VM_SHARED | VM_MAYSHARE) && !vma_is_shmem(vma))
+			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
 		/*
@@ -1556,6 +1759,12 @@ int __khugepaged_enter(struct mm_struct *mm)
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma)
 {
 	unsigned long hstart, hend;
+	if (shmem_huge_enabled(vma)) {
+		/* shmem mappings are collapsed in the page cache */
+		if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags))
+			return __khugepaged_enter(vma->vm_mm);
+		return 0;
+	}
 	if (!vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
@@ -1993,6 +2202,151 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
+#ifdef CONFIG_SHMEM
+/*
+ * Replace the page table mapping a complete shmem extent, wholly or in
+ * part, with a huge pmd.  Called with mmap_sem held for writing, which
+ * keeps faults away; i_mmap_lock keeps the rmap walkers away.
+ */
+static void collapse_shmem_pmd(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long haddr)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t *pmd, _pmd, entry;
+	pte_t *pte, *_pte;
+	spinlock_t *ptl;
+	int i;
+
+	pmd = shmem_pmd_lookup(mm, haddr);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return;
+	page = shmem_huge_extent(vma, linear_page_index(vma, haddr));
+	if (!page)
+		return;
+	if (vma->vm_flags & VM_WRITE)
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			set_page_dirty(page + i);
+
+	spin_lock(&mapping->i_mmap_lock);
+	pte = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+	for (i = 0, _pte = pte; i < HPAGE_PMD_NR; i++, _pte++) {
+		if (pte_none(*_pte))
+			continue;
+		if (!pte_present(*_pte) ||
+		    pte_pfn(*_pte) != page_to_pfn(page) + i)
+			break;
+	}
+	pte_unmap_unlock(pte, ptl);
+	if (i < HPAGE_PMD_NR) {
+		spin_unlock(&mapping->i_mmap_lock);
+		for (i = 0; i < HPAGE_PMD_NR; i++) {
+			unlock_page(page + i);
+			page_cache_release(page + i);
+		}
+		return;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_clear_flush_notify(vma, haddr, pmd);
+	spin_unlock(&mm->page_table_lock);
+
+	/*
+	 * Pages mapped by a pte hand its reference over to the pmd, the
+	 * others keep the one taken by shmem_huge_extent().
+	 */
+	pte = pte_offset_map(&_pmd, haddr);
+	for (i = 0, _pte = pte; i < HPAGE_PMD_NR; i++, _pte++) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			page_add_file_rmap(page + i);
+			add_mm_counter(mm, MM_FILEPAGES, 1);
+			continue;
+		}
+		if (pte_dirty(pteval))
+			set_page_dirty(page + i);
+		pte_clear(mm, haddr + i * PAGE_SIZE, _pte);
+		page_cache_release(page + i);
+	}
+	pte_unmap(pte);
+	pgtable = pmd_pgtable(_pmd);
+
+	entry = mk_pmd(page, vma->vm_page_prot);
+	if (vma->vm_flags & VM_WRITE)
+		entry = pmd_mkwrite(pmd_mkdirty(entry));
+	entry = pmd_mkhuge(entry);
+
+	spin_lock(&mm->page_table_lock);
+	set_pmd_at(mm, haddr, pmd, entry);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	pte_free(mm, pgtable);
+	spin_unlock(&mapping->i_mmap_lock);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		unlock_page(page + i);
+	khugepaged_pages_collapsed++;
+}
+
+/*
+ * Make the shmem extent behind @address contiguous, then map it with a
+ * huge pmd if a page table maps it now.  Returns 1 if mmap_sem was
+ * released, like khugepaged_scan_pmd().
+ */
+static int khugepaged_scan_shmem(struct mm_struct *mm,
+				 struct vm_area_struct *vma,
+				 unsigned long address)
+{
+	struct file *file = vma->vm_file;
+	pgoff_t hindex = linear_page_index(vma, address);
+	struct page *page;
+	pmd_t *pmd;
+	int i;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pmd = shmem_pmd_lookup(mm, address);
+	if (pmd && pmd_trans_huge(*pmd))
+		return 0;
+	/* cheap check for an extent with holes, before dropping mmap_sem */
+	for (i = 0; i < HPAGE_PMD_NR; i += HPAGE_PMD_NR - 1) {
+		page = find_get_page(file->f_mapping, hindex + i);
+		if (!page)
+			return 0;
+		page_cache_release(page);
+	}
+
+	get_file(file);
+	up_read(&mm->mmap_sem);
+	if (shmem_collapse_extent(file->f_mapping->host, hindex)) {
+		down_write(&mm->mmap_sem);
+		if (unlikely(khugepaged_test_exit(mm)))
+			goto out;
+		vma = find_vma(mm, address);
+		if (!vma || vma->vm_start > address ||
+		    address + HPAGE_PMD_SIZE > vma->vm_end ||
+		    vma->vm_file != file || !shmem_huge_enabled(vma) ||
+		    linear_page_index(vma, address) != hindex)
+			goto out;
+		collapse_shmem_pmd(mm, vma, address);
+out:
+		up_write(&mm->mmap_sem);
+	}
+	fput(file);
+	return 1;
+}
+#else
+static inline int khugepaged_scan_shmem(struct mm_struct *mm,
+					struct vm_area_struct *vma,
+					unsigned long address)
+{
+	return 0;
+}
+#endif /* CONFIG_SHMEM */
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 {
@@ -2024,6 +2378,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	progress++;
 	for (; vma; vma = vma->vm_next) {
 		unsigned long hstart, hend;
+		int shmem;
 
 		cond_resched();
 		if (unlikely(khugepaged_test_exit(mm))) {
@@ -2031,15 +2386,20 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
-		     !khugepaged_always()) ||
-		    (vma->vm_flags & VM_NOHUGEPAGE)) {
+		shmem = shmem_huge_enabled(vma);
+		if (!shmem && ((!(vma->vm_flags & VM_HUGEPAGE) &&
+				!khugepaged_always()) ||
+			       (vma->vm_flags & VM_NOHUGEPAGE))) {
 		skip:
 			progress++;
 			continue;
 		}
 		/* VM_PFNMAP vmas may have vm_ops null but vm_file set */
-		if (!vma->anon_vma || vma->vm_ops || vma->vm_file)
+		if (!shmem && (!vma->anon_vma || vma->vm_ops || vma->vm_file))
+			goto skip;
+		/* huge pmds need file offsets aligned like addresses */
+		if (shmem && (((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff) &
+			      (HPAGE_PMD_NR - 1)))
 			goto skip;
 		if (is_vma_temporary_stack(vma))
 			goto skip;
@@ -2065,9 +2425,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (shmem)
+				ret = khugepaged_scan_shmem(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2262,7 +2626,8 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+void __split_huge_page_pmd(struct mm_struct *mm, unsigned long address,
+			   pmd_t *pmd)
 {
 	struct page *page;
 
@@ -2272,6 +2637,13 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+#ifdef CONFIG_SHMEM
+	if (!PageHead(page)) {
+		spin_unlock(&mm->page_table_lock);
+		__split_shmem_pmd(mm, address & HPAGE_PMD_MASK, pmd);
+		return;
+	}
+#endif
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -2306,7 +2678,31 @@ static void split_huge_page_address(struct mm_struct *mm,
 	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
 	 * materialize from under us.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd(mm, address, pmd);
+}
+
+/*
+ * Split every huge pmd of @vma, for a caller which is going to handle it
+ * with ptes only from now on.  mmap_sem must be held for writing.
+ */
+void split_huge_page_vma(struct vm_area_struct *vma)
+{
+	unsigned long addr;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	for (addr = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+	     addr + HPAGE_PMD_SIZE <= vma->vm_end; addr += HPAGE_PMD_SIZE) {
+		pgd = pgd_offset(vma->vm_mm, addr);
+		if (!pgd_present(*pgd))
+			continue;
+		pud = pud_offset(pgd, addr);
+		if (!pud_present(*pud))
+			continue;
+		pmd = pmd_offset(pud, addr);
+		split_huge_page_pmd(vma->vm_mm, addr, pmd);
+	}
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
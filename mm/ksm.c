@@ -36,6 +36,7 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 
+#include <crypto/hash.h>
 #include <asm/tlbflush.h>
 #include "internal.h"
 
@@ -193,6 +194,23 @@ static unsigned int ksm_thread_sleep_millisecs = 20;
 #define KSM_RUN_UNMERGE	2
 static unsigned int ksm_run = KSM_RUN_STOP;
 
+/* Whether to merge all-zero pages with the zero page, not into the trees */
+static unsigned int ksm_use_zero_pages;
+
+/* The number of page slots merged with the zero page, since boot */
+static unsigned long ksm_zero_pages_merged;
+
+/* VM_MERGEABLE_LOWPRI areas are scanned once in this many full scans */
+static unsigned int ksm_lowpri_scan_ratio = 4;
+
+/* crc32c transform for the checksums if the cpu helps, else NULL: jhash2 */
+static struct crypto_shash *ksm_crc32c_tfm;
+
+/* The checksum of the zero page, by whichever of the above is in use */
+static u32 zero_checksum;
+
+static struct task_struct *ksm_thread;
+
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
 static DEFINE_MUTEX(ksm_thread_mutex);
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
@@ -686,11 +704,50 @@ static u32 calc_checksum(struct page *page)
 {
 	u32 checksum;
 	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	if (ksm_crc32c_tfm) {
+		struct {
+			struct shash_desc shash;
+			char ctx[crypto_shash_descsize(ksm_crc32c_tfm)];
+		} desc;
+
+		desc.shash.tfm = ksm_crc32c_tfm;
+		desc.shash.flags = 0;
+		crypto_shash_digest(&desc.shash, addr, PAGE_SIZE, (u8 *)&checksum);
+	} else
+		checksum = jhash2(addr, PAGE_SIZE / 4, 17);
 	kunmap_atomic(addr, KM_USER0);
 	return checksum;
 }
 
+/*
+ * Checksumming every page on every pass is much of what ksmd costs, so
+ * use crc32c when the cpu has an instruction for it (SSE4.2 on x86):
+ * that is several times faster than jhash2, whereas the generic crc32c
+ * is slower.  This is done when ksmd is first set running, so that a
+ * modular driver can be loaded, with ksm_thread_mutex held so that
+ * ksmd sees either the old or the new algorithm for the whole batch.
+ * A checksum change after switching only delays merging by one pass.
+ */
+static void ksm_checksum_init(void)
+{
+	static bool done;
+	struct crypto_shash *tfm;
+
+	if (done)
+		return;
+	done = true;
+
+	tfm = crypto_alloc_shash("crc32c", 0, 0);
+	if (!IS_ERR(tfm)) {
+		if (strcmp(crypto_tfm_alg_driver_name(crypto_shash_tfm(tfm)),
+			   "crc32c-generic"))
+			ksm_crc32c_tfm = tfm;
+		else
+			crypto_free_shash(tfm);
+	}
+	zero_checksum = calc_checksum(ZERO_PAGE(0));
+}
+
 static int memcmp_pages(struct page *page1, struct page *page2)
 {
 	char *addr1, *addr2;
@@ -769,7 +826,7 @@ out:
  * replace_page - replace page in vma by new ksm page
  * @vma:      vma that holds the pte pointing to page
  * @page:     the page we are replacing by kpage
- * @kpage:    the ksm page we replace page by
+ * @kpage:    the ksm page we replace page by, or the zero page
  * @orig_pte: the original value of the pte
  *
  * Returns 0 on success, -EFAULT on failure.
@@ -782,6 +839,7 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 	pud_t *pud;
 	pmd_t *pmd;
 	pte_t *ptep;
+	pte_t newpte;
 	spinlock_t *ptl;
 	unsigned long addr;
 	int err = -EFAULT;
@@ -809,12 +867,20 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 		goto out;
 	}
 
-	get_page(kpage);
-	page_add_anon_rmap(kpage, vma, addr);
+	if (kpage != ZERO_PAGE(addr)) {
+		get_page(kpage);
+		page_add_anon_rmap(kpage, vma, addr);
+		newpte = mk_pte(kpage, vma->vm_page_prot);
+	} else {
+		/* As do_anonymous_page() maps it: no refcount, no rmap */
+		newpte = pte_mkspecial(pfn_pte(page_to_pfn(kpage),
+					       vma->vm_page_prot));
+		dec_mm_counter(mm, MM_ANONPAGES);
+	}
 
 	flush_cache_page(vma, addr, pte_pfn(*ptep));
 	ptep_clear_flush(vma, addr, ptep);
-	set_pte_at_notify(mm, addr, ptep, mk_pte(kpage, vma->vm_page_prot));
+	set_pte_at_notify(mm, addr, ptep, newpte);
 
 	page_remove_rmap(page);
 	if (!page_mapped(page))
@@ -859,7 +925,8 @@ static int page_trans_compound_anon_split(struct page *page)
  * @vma: the vma that holds the pte pointing to page
  * @page: the PageAnon page that we want to replace with kpage
  * @kpage: the PageKsm page that we want to map instead of page,
- *         or NULL the first time when we want to use page as kpage.
+ *         or NULL the first time when we want to use page as kpage,
+ *         or the zero page when page is all zeroes.
  *
  * This function returns 0 if the pages were merged, -EFAULT otherwise.
  */
@@ -901,7 +968,13 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 			 * While we hold page lock, upgrade page from
 			 * PageAnon+anon_vma to PageKsm+NULL stable_node:
 			 * stable_tree_insert() will update stable_node.
+			 *
+			 * A clean MADV_FREE page must not be discarded
+			 * by reclaim once other processes share it:
+			 * dirty it so that it gets swapped instead.
 			 */
+			if (!PageDirty(page))
+				SetPageDirty(page);
 			set_page_stable_node(page, NULL);
 			mark_page_accessed(page);
 			err = 0;
@@ -911,7 +984,8 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 
 	if ((vma->vm_flags & VM_LOCKED) && kpage && !err) {
 		munlock_vma_page(page);
-		if (!PageMlocked(kpage)) {
+		/* The zero page is never mlocked */
+		if (PageKsm(kpage) && !PageMlocked(kpage)) {
 			unlock_page(page);
 			lock_page(kpage);
 			mlock_vma_page(kpage);
@@ -955,6 +1029,34 @@ out:
 	return err;
 }
 
+/*
+ * try_to_merge_zero_page - map the zero page in place of an all-zero page,
+ * which frees it without involving either tree or a stable_node.
+ *
+ * This function returns 0 if the page was merged, -EFAULT otherwise.
+ */
+static int try_to_merge_zero_page(struct rmap_item *rmap_item,
+				  struct page *page)
+{
+	struct mm_struct *mm = rmap_item->mm;
+	struct vm_area_struct *vma;
+	int err = -EFAULT;
+
+	down_read(&mm->mmap_sem);
+	if (ksm_test_exit(mm))
+		goto out;
+	vma = find_vma(mm, rmap_item->address);
+	if (!vma || vma->vm_start > rmap_item->address)
+		goto out;
+
+	err = try_to_merge_one_page(vma, page, ZERO_PAGE(rmap_item->address));
+	if (!err)
+		ksm_zero_pages_merged++;
+out:
+	up_read(&mm->mmap_sem);
+	return err;
+}
+
 /*
  * try_to_merge_two_pages - take two identical pages and prepare them
  * to be merged into one page.
@@ -1172,7 +1274,8 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 }
 
 /*
- * cmp_and_merge_page - first see if page can be merged into the stable tree;
+ * cmp_and_merge_page - first see if page is all zeroes and can be replaced
+ * by the zero page, then if page can be merged into the stable tree;
  * if not, compare checksum to previous and if it's the same, see if page can
  * be inserted into the unstable tree, or merged with a page already there and
  * both transferred to the stable tree.
@@ -1191,7 +1294,18 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
-	/* We first start with searching the page inside the stable tree */
+	/*
+	 * An all-zero page which has stayed that way since the last pass
+	 * is simply replaced by the zero page: no tree walk, no memcmp
+	 * against other candidates, and its memory is freed outright.
+	 */
+	checksum = calc_checksum(page);
+	if (ksm_use_zero_pages && checksum == zero_checksum &&
+	    rmap_item->oldchecksum == checksum && !PageKsm(page) &&
+	    !try_to_merge_zero_page(rmap_item, page))
+		return;
+
+	/* Then search for the page inside the stable tree */
 	kpage = stable_tree_search(page);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
@@ -1214,7 +1328,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1333,6 +1446,23 @@ next_mm:
 			ksm_scan.address = vma->vm_start;
 		if (!vma->anon_vma)
 			ksm_scan.address = vma->vm_end;
+		if ((vma->vm_flags & VM_MERGEABLE_LOWPRI) &&
+		    ksm_scan.seqnr % ksm_lowpri_scan_ratio) {
+			/*
+			 * Not this pass: step over its rmap_items, keeping
+			 * them and any merges they have for the next one.
+			 * Those in the unstable tree must come out of it,
+			 * as it is rebuilt on every pass.
+			 */
+			while (*ksm_scan.rmap_list &&
+			       (*ksm_scan.rmap_list)->address < vma->vm_end) {
+				rmap_item = *ksm_scan.rmap_list;
+				if (rmap_item->address & UNSTABLE_FLAG)
+					remove_rmap_item_from_tree(rmap_item);
+				ksm_scan.rmap_list = &rmap_item->rmap_list;
+			}
+			ksm_scan.address = vma->vm_end;
+		}
 
 		while (ksm_scan.address < vma->vm_end) {
 			if (ksm_test_exit(mm))
@@ -1465,11 +1595,15 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 	int err;
 
 	switch (advice) {
+	case MADV_MERGEABLE_LOWPRI:
+		if (!VM_MERGEABLE_LOWPRI)
+			return -EINVAL;
+		/* fall through */
 	case MADV_MERGEABLE:
 		/*
 		 * Be somewhat over-protective for now!
 		 */
-		if (*vm_flags & (VM_MERGEABLE | VM_SHARED  | VM_MAYSHARE   |
+		if (*vm_flags & (VM_SHARED  | VM_MAYSHARE   |
 				 VM_PFNMAP    | VM_IO      | VM_DONTEXPAND |
 				 VM_RESERVED  | VM_HUGETLB | VM_INSERTPAGE |
 				 VM_NONLINEAR | VM_MIXEDMAP | VM_SAO))
@@ -1481,6 +1615,10 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 				return err;
 		}
 
+		/* Either advice may change the priority of a mergeable area */
+		*vm_flags &= ~VM_MERGEABLE_LOWPRI;
+		if (advice == MADV_MERGEABLE_LOWPRI)
+			*vm_flags |= VM_MERGEABLE_LOWPRI;
 		*vm_flags |= VM_MERGEABLE;
 		break;
 
@@ -1494,7 +1632,7 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 				return err;
 		}
 
-		*vm_flags &= ~VM_MERGEABLE;
+		*vm_flags &= ~(VM_MERGEABLE | VM_MERGEABLE_LOWPRI);
 		break;
 	}
 
@@ -1904,6 +2042,8 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 */
 
 	mutex_lock(&ksm_thread_mutex);
+	if (flags & KSM_RUN_MERGE)
+		ksm_checksum_init();
 	if (ksm_run != flags) {
 		ksm_run = flags;
 		if (flags & KSM_RUN_UNMERGE) {
@@ -1970,6 +2110,76 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t use_zero_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_use_zero_pages);
+}
+
+static ssize_t use_zero_pages_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = strict_strtoul(buf, 10, &value);
+	if (err || value > 1)
+		return -EINVAL;
+
+	ksm_use_zero_pages = value;
+
+	return count;
+}
+KSM_ATTR(use_zero_pages);
+
+static ssize_t zero_pages_merged_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_zero_pages_merged);
+}
+KSM_ATTR_RO(zero_pages_merged);
+
+static ssize_t lowpri_scan_ratio_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_lowpri_scan_ratio);
+}
+
+static ssize_t lowpri_scan_ratio_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long ratio;
+
+	err = strict_strtoul(buf, 10, &ratio);
+	if (err || !ratio || ratio > UINT_MAX)
+		return -EINVAL;
+
+	ksm_lowpri_scan_ratio = ratio;
+
+	return count;
+}
+KSM_ATTR(lowpri_scan_ratio);
+
+static ssize_t checksum_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", ksm_crc32c_tfm ? "crc32c" : "jhash2");
+}
+KSM_ATTR_RO(checksum);
+
+static ssize_t ksmd_cpu_msecs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	u64 runtime = task_sched_runtime(ksm_thread);
+
+	do_div(runtime, NSEC_PER_MSEC);
+	return sprintf(buf, "%llu\n", (unsigned long long)runtime);
+}
+KSM_ATTR_RO(ksmd_cpu_msecs);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1979,6 +2189,11 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&use_zero_pages_attr.attr,
+	&zero_pages_merged_attr.attr,
+	&lowpri_scan_ratio_attr.attr,
+	&checksum_attr.attr,
+	&ksmd_cpu_msecs_attr.attr,
 	NULL,
 };
 
@@ -1990,7 +2205,6 @@ static struct attribute_group ksm_attr_group = {
 
 static int __init ksm_init(void)
 {
-	struct task_struct *ksm_thread;
 	int err;
 
 	err = ksm_slab_init();
@@ -2012,6 +2226,7 @@ static int __init ksm_init(void)
 		goto out_free;
 	}
 #else
+	ksm_checksum_init();
 	ksm_run = KSM_RUN_MERGE;	/* no way for user to start it */
 
 #endif /* CONFIG_SYSFS */
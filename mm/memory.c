@@ -57,6 +57,8 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
+#include <linux/debugfs.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -919,6 +921,7 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	init_rss_vec(rss);
 
 	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -1017,8 +1020,10 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next-addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
-				split_huge_page_pmd(vma->vm_mm, pmd);
+				/* truncate splits shmem pmds without mmap_sem */
+				VM_BUG_ON(!(vma->vm_flags & VM_SHARED) &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
+				split_huge_page_pmd(vma->vm_mm, addr, pmd);
 			} else if (zap_huge_pmd(tlb, vma, pmd)) {
 				(*zap_work)--;
 				continue;
@@ -1308,7 +1313,7 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 	}
 	if (pmd_trans_huge(*pmd)) {
 		if (flags & FOLL_SPLIT) {
-			split_huge_page_pmd(mm, pmd);
+			split_huge_page_pmd(mm, address, pmd);
 			goto split_fallthrough;
 		}
 		spin_lock(&mm->page_table_lock);
@@ -2975,6 +2980,39 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - setup new PTE entry for given page and add reverse page mapping.
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map
+ * @pte: pointer to target page table entry
+ * @write: true, if new entry is writable
+ * @anon: true, if it's anonymous page
+ *
+ * Caller must hold page table lock relevant for @pte.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	if (anon) {
+		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -2995,7 +3033,6 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pte_t *page_table;
 	spinlock_t *ptl;
 	struct page *page;
-	pte_t entry;
 	int anon = 0;
 	int charged = 0;
 	struct page *dirty_page = NULL;
@@ -3099,25 +3136,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (likely(pte_same(*page_table, orig_pte))) {
-		flush_icache_page(vma, page);
-		entry = mk_pte(page, vma->vm_page_prot);
-		if (flags & FAULT_FLAG_WRITE)
-			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
-		if (anon) {
-			inc_mm_counter_fast(mm, MM_ANONPAGES);
-			page_add_new_anon_rmap(page, vma, address);
-		} else {
-			inc_mm_counter_fast(mm, MM_FILEPAGES);
-			page_add_file_rmap(page);
-			if (flags & FAULT_FLAG_WRITE) {
-				dirty_page = page;
-				get_page(dirty_page);
-			}
+		do_set_pte(vma, address, page, page_table,
+			   flags & FAULT_FLAG_WRITE, anon);
+		if (!anon && (flags & FAULT_FLAG_WRITE)) {
+			dirty_page = page;
+			get_page(dirty_page);
 		}
-		set_pte_at(mm, address, page_table, entry);
-
-		/* no need to invalidate: a not-present page won't be cached */
-		update_mmu_cache(vma, address, page_table);
 	} else {
 		if (charged)
 			mem_cgroup_uncharge_page(page);
@@ -3161,6 +3185,102 @@ unwritable_page:
 	return ret;
 }
 
+/*
+ * Read faults on file mappings also map the pages around the faulting
+ * address that are already in the page cache, up to fault_around_bytes
+ * worth of them, to save on the minor faults of sequential accesses.
+ */
+static unsigned long fault_around_bytes = 65536;
+
+static inline unsigned long fault_around_pages(void)
+{
+	return fault_around_bytes >> PAGE_SHIFT;
+}
+
+static inline unsigned long fault_around_mask(void)
+{
+	return ~(fault_around_bytes - 1) & PAGE_MASK;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > PTRS_PER_PTE)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		fault_around_bytes = PAGE_SIZE; /* disables fault-around */
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
+		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
+
+static int __init fault_around_debugfs(void)
+{
+	void *ret;
+
+	ret = debugfs_create_file("fault_around_bytes", 0644, NULL, NULL,
+			&fault_around_bytes_fops);
+	if (!ret)
+		printk(KERN_WARNING
+		       "Failed to create fault_around_bytes in debugfs\n");
+	return 0;
+}
+late_initcall(fault_around_debugfs);
+#endif
+
+/*
+ * Let ->map_pages() map the cached pages in the fault_around_bytes
+ * aligned window around @address, clamped to the vma and to the page
+ * table that @pte is in.  Called with the page table lock held.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long start_addr;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	start_addr = max(address & fault_around_mask(), vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either end of page table or end of vma
+	 * or fault_around_pages() from pgoff, depending what is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			pgoff + fault_around_pages() - 1);
+
+	/* Check if it makes any sense to call ->map_pages */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
 		unsigned int flags, pte_t orig_pte)
@@ -3168,6 +3288,23 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
+	/*
+	 * Map the cached pages around a read fault first: if the page
+	 * being faulted on was one of them, we are done.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    fault_around_pages() > 1) {
+		spinlock_t *ptl = pte_lockptr(mm, pmd);
+
+		spin_lock(ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		spin_unlock(ptl);
+	}
+
 	pte_unmap(page_table);
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
@@ -3204,6 +3341,60 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault, on a pte made inaccessible by change_prot_numa():
+ * make it accessible again, tell the scheduler which node the page was
+ * used from and move the page if its policy wants it elsewhere.
+ *
+ * We enter with non-exclusive mmap_sem, and pte mapped but not yet
+ * locked.  We return with the pte unmapped and unlocked.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *ptep, pmd_t *pmd, pte_t entry)
+{
+	spinlock_t *ptl;
+	struct page *page;
+	int page_nid, target_nid;
+	bool local;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*ptep, entry))) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+
+	/* Not present in the TLB, so no flush is needed */
+	entry = pte_mknonnuma(entry);
+	set_pte_at(mm, address, ptep, entry);
+	update_mmu_cache(vma, address, ptep);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(ptep, ptl);
+
+	page_nid = page_to_nid(page);
+	local = page_nid == numa_node_id();
+	count_vm_event(NUMA_HINT_FAULTS);
+	if (local)
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	target_nid = mpol_misplaced(page, vma, address);
+	if (target_nid == -1)
+		put_page(page);
+	else if (migrate_misplaced_page(page, target_nid))
+		page_nid = target_nid;
+
+	task_numa_fault(page_nid, 1, local);
+	return 0;
+}
+#endif
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3242,6 +3433,11 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+#ifdef CONFIG_NUMA_BALANCING
+	if (pte_numa(entry))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+#endif
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3298,14 +3494,22 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+	if (pmd_none(*pmd) && shmem_huge_enabled(vma)) {
+		return do_huge_pmd_shmem_page(mm, vma, address, pmd, flags);
+	} else if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
 		if (!vma->vm_ops)
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
 	} else {
 		pmd_t orig_pmd = *pmd;
 		barrier();
-		if (pmd_trans_huge(orig_pmd)) {
+		if (pmd_trans_huge(orig_pmd) && vma->vm_ops) {
+			/* a shmem pmd is never write protected: split it */
+			if (flags & FAULT_FLAG_WRITE && !pmd_write(orig_pmd))
+				split_huge_page_pmd(mm, address, pmd);
+			else
+				return 0;
+		} else if (pmd_trans_huge(orig_pmd)) {
 			if (flags & FAULT_FLAG_WRITE &&
 			    !pmd_write(orig_pmd) &&
 			    !pmd_trans_splitting(orig_pmd))
@@ -3336,6 +3540,295 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults
+ *
+ * Faults on not-present ptes of anonymous and page cache backed vmas
+ * are first tried without mmap_sem, so that the threads of a process
+ * do not queue up behind an mmap(), munmap() or mprotect() elsewhere
+ * in its address space.  The vma is looked up under RCU and its
+ * sequence count noted; everything the fault derives from the vma is
+ * revalidated against that count once the page table lock is held,
+ * and the new pte is only installed if nothing changed.  Whatever
+ * cannot be handled this way, including all errors, is answered with
+ * VM_FAULT_RETRY, and the architecture code falls back to the regular
+ * fault path under mmap_sem.
+ *
+ * Without mmap_sem nothing keeps the page tables from being freed by
+ * a concurrent munmap(), so they are walked with interrupts disabled
+ * like get_user_pages_fast() does: freeing them requires a TLB flush
+ * IPI that this cpu cannot answer meanwhile.
+ */
+
+static pmd_t *spf_walk(struct mm_struct *mm, unsigned long address,
+		       pmd_t *orig_pmd, pte_t *orig_pte)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out;
+	pmd = pmd_offset(pud, address);
+	*orig_pmd = *pmd;
+	barrier();
+	/* allocating page tables and huge pmds are left to mmap_sem holders */
+	if (pmd_none(*orig_pmd) || pmd_trans_huge(*orig_pmd) ||
+	    unlikely(pmd_bad(*orig_pmd)))
+		goto out;
+	pte = pte_offset_map(pmd, address);
+	*orig_pte = *pte;
+	pte_unmap(pte);
+	local_irq_enable();
+	return pmd;
+out:
+	local_irq_enable();
+	return NULL;
+}
+
+/*
+ * Map and lock the pte if the vma is still the one seen at @seq.  The
+ * lock can only be trylocked with interrupts disabled, as its holder
+ * may be waiting for this cpu to answer a TLB flush IPI.
+ */
+static pte_t *spf_pte_map_lock(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned int seq,
+		unsigned long address, pmd_t *pmd, pmd_t orig_pmd,
+		spinlock_t **ptlp)
+{
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	local_irq_disable();
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		goto out;
+	if (pmd_val(*pmd) != pmd_val(orig_pmd))
+		goto out;
+	ptl = pte_lockptr(mm, pmd);
+	pte = pte_offset_map(pmd, address);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out;
+	}
+	/*
+	 * Any change to the vma from here on is followed by the page
+	 * table update for it, which has to wait for this lock.
+	 */
+	if (read_seqcount_retry(&vma->vm_sequence, seq)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+	local_irq_enable();
+	*ptlp = ptl;
+	return pte;
+out:
+	local_irq_enable();
+	return NULL;
+}
+
+static int spf_anonymous_page(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned int seq,
+		unsigned long address, pmd_t *pmd, pmd_t orig_pmd,
+		unsigned int flags)
+{
+	struct page *page = NULL;
+	spinlock_t *ptl;
+	pte_t *pte, entry;
+	int ret = VM_FAULT_RETRY;
+
+	if (!(flags & FAULT_FLAG_WRITE)) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						vma->vm_page_prot));
+	} else {
+		/* setting up the anon_vma needs mmap_sem */
+		if (!vma->anon_vma)
+			return VM_FAULT_RETRY;
+#ifdef CONFIG_NUMA
+		/*
+		 * mbind() may replace and free a vma policy under us, so
+		 * allocate by the task's own policy, and only if the vma
+		 * has none: setting one changes the sequence count.
+		 */
+		if (ACCESS_ONCE(vma->vm_policy))
+			return VM_FAULT_RETRY;
+#endif
+		page = alloc_page(GFP_HIGHUSER_MOVABLE);
+		if (!page)
+			return VM_FAULT_RETRY;
+		clear_user_highpage(page, address);
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			return VM_FAULT_RETRY;
+		}
+		entry = mk_pte(page, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	}
+
+	pte = spf_pte_map_lock(mm, vma, seq, address, pmd, orig_pmd, &ptl);
+	if (!pte)
+		goto release;
+	if (!pte_none(*pte)) {
+		/* another thread got there first */
+		pte_unmap_unlock(pte, ptl);
+		ret = 0;
+		goto release;
+	}
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+	update_mmu_cache(vma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	return 0;
+
+release:
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	return ret;
+}
+
+static int spf_file_page(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned int seq,
+		unsigned long address, pmd_t *pmd, pmd_t orig_pmd,
+		pte_t orig_pte, unsigned int flags)
+{
+	struct vm_fault vmf;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int ret;
+
+	vmf.virtual_address = (void __user *)(address & PAGE_MASK);
+	vmf.pgoff = (((address & PAGE_MASK) - vma->vm_start) >> PAGE_SHIFT) +
+		    vma->vm_pgoff;
+	/* the fault must not drop an mmap_sem that is not held */
+	vmf.flags = flags & ~FAULT_FLAG_ALLOW_RETRY;
+	vmf.page = NULL;
+
+	/*
+	 * Map the cached pages around the fault first, as
+	 * do_linear_fault() does: the vma cannot change while
+	 * the revalidated pte lock is held.
+	 */
+	if (vma->vm_ops->map_pages && fault_around_pages() > 1) {
+		pte = spf_pte_map_lock(mm, vma, seq, address, pmd, orig_pmd,
+				       &ptl);
+		if (!pte)
+			return VM_FAULT_RETRY;
+		do_fault_around(vma, address, pte, vmf.pgoff, flags);
+		if (!pte_same(*pte, orig_pte)) {
+			pte_unmap_unlock(pte, ptl);
+			return 0;
+		}
+		pte_unmap_unlock(pte, ptl);
+	}
+
+	/* don't start I/O for an offset computed from a stale vma */
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		return VM_FAULT_RETRY;
+
+	ret = vma->vm_ops->fault(vma, &vmf);
+	if (unlikely(ret & (VM_FAULT_ERROR | VM_FAULT_NOPAGE |
+			    VM_FAULT_RETRY)))
+		return VM_FAULT_RETRY;
+
+	if (unlikely(!(ret & VM_FAULT_LOCKED)))
+		lock_page(vmf.page);
+	ret &= VM_FAULT_MAJOR;
+
+	if (unlikely(PageHWPoison(vmf.page))) {
+		ret = VM_FAULT_RETRY;
+		goto release;
+	}
+
+	pte = spf_pte_map_lock(mm, vma, seq, address, pmd, orig_pmd, &ptl);
+	if (!pte) {
+		ret = VM_FAULT_RETRY;
+		goto release;
+	}
+	if (likely(pte_same(*pte, orig_pte))) {
+		do_set_pte(vma, address, vmf.page, pte, false, false);
+		pte_unmap_unlock(pte, ptl);
+		unlock_page(vmf.page);
+		return ret;
+	}
+	pte_unmap_unlock(pte, ptl);
+release:
+	unlock_page(vmf.page);
+	page_cache_release(vmf.page);
+	return ret;
+}
+
+/**
+ * handle_speculative_fault - try to handle a page fault without mmap_sem
+ * @mm: address space of the current task
+ * @address: faulting address
+ * @flags: FAULT_FLAG_xxx
+ *
+ * Only not-present faults may be passed in.  Returns VM_FAULT_RETRY if
+ * the fault has to be handled by handle_mm_fault() under mmap_sem, the
+ * fault result otherwise.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	unsigned long vm_flags;
+	unsigned int seq;
+	pmd_t *pmd, orig_pmd;
+	pte_t orig_pte;
+	int ret = VM_FAULT_RETRY;
+
+	vma = get_vma_speculative(mm, address, &seq);
+	if (!vma)
+		goto out;
+
+	/* special mappings, stack growth and access errors take mmap_sem */
+	vm_flags = ACCESS_ONCE(vma->vm_flags);
+	if (vm_flags & (VM_HUGETLB | VM_PFNMAP | VM_MIXEDMAP | VM_IO |
+			VM_NONLINEAR | VM_GROWSDOWN | VM_GROWSUP))
+		goto out_put;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (!(vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_put;
+
+	pmd = spf_walk(mm, address, &orig_pmd, &orig_pte);
+	if (!pmd || !pte_none(orig_pte))
+		goto out_put;
+
+	if (!vma->vm_ops)
+		ret = spf_anonymous_page(mm, vma, seq, address,
+					 pmd, orig_pmd, flags);
+	else if (vma->vm_ops->fault == filemap_fault &&
+		 !(flags & FAULT_FLAG_WRITE))
+		ret = spf_file_page(mm, vma, seq, address,
+				    pmd, orig_pmd, orig_pte, flags);
+out_put:
+	put_vma(vma);
+out:
+	if (ret & VM_FAULT_RETRY) {
+		count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+	} else {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPECULATIVE_PGFAULT);
+	}
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
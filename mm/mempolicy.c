@@ -514,7 +514,7 @@ static inline int check_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		split_huge_page_pmd(vma->vm_mm, pmd);
+		split_huge_page_pmd(vma->vm_mm, addr, pmd);
 		if (pmd_none_or_clear_bad(pmd))
 			continue;
 		if (check_pte_range(vma, pmd, addr, next, nodes,
@@ -564,6 +564,118 @@ static inline int check_pgd_range(struct vm_area_struct *vma,
 	return 0;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Turn the present ptes of a range into NUMA hinting ptes, so that the
+ * next access to each page faults and do_numa_page() learns which node
+ * it is used from.  Called with mmap_sem held for read: a huge pmd may
+ * be set up under us, so the pmd is only looked at through a copy, and
+ * huge pmds are left alone.
+ */
+static unsigned long change_prot_numa_pte_range(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+	unsigned long pages = 0;
+
+	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (!pte_present(ptent) || pte_numa(ptent))
+			continue;
+		page = vm_normal_page(vma, addr, ptent);
+		/* Same exclusions as check_pte_range() */
+		if (!page || PageReserved(page) || PageKsm(page))
+			continue;
+
+		ptent = ptep_modify_prot_start(mm, addr, pte);
+		ptent = pte_mknuma(ptent);
+		ptep_modify_prot_commit(mm, addr, pte, ptent);
+		pages++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+	return pages;
+}
+
+static unsigned long change_prot_numa_pmd_range(struct vm_area_struct *vma,
+		pud_t *pud, unsigned long addr, unsigned long end)
+{
+	pmd_t *pmd;
+	unsigned long next;
+	unsigned long pages = 0;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		pmd_t pmdval = *pmd;
+
+		barrier();
+		next = pmd_addr_end(addr, end);
+		if (pmd_none(pmdval) || pmd_trans_huge(pmdval))
+			continue;
+		if (unlikely(pmd_bad(pmdval))) {
+			pmd_clear_bad(pmd);
+			continue;
+		}
+		pages += change_prot_numa_pte_range(vma, pmd, addr, next);
+	} while (pmd++, addr = next, addr != end);
+	return pages;
+}
+
+static unsigned long change_prot_numa_pud_range(struct vm_area_struct *vma,
+		pgd_t *pgd, unsigned long addr, unsigned long end)
+{
+	pud_t *pud;
+	unsigned long next;
+	unsigned long pages = 0;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		pages += change_prot_numa_pmd_range(vma, pud, addr, next);
+	} while (pud++, addr = next, addr != end);
+	return pages;
+}
+
+/**
+ * change_prot_numa - arm NUMA hinting faults on a range of a vma
+ * @vma: vma to scan, which must be accessible
+ * @start: start of the range
+ * @end: end of the range, within @vma
+ *
+ * Returns the number of ptes changed.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+		unsigned long start, unsigned long end)
+{
+	pgd_t *pgd;
+	unsigned long addr = start;
+	unsigned long next;
+	unsigned long pages = 0;
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		pages += change_prot_numa_pud_range(vma, pgd, addr, next);
+	} while (pgd++, addr = next, addr != end);
+
+	if (pages) {
+		flush_tlb_range(vma, start, end);
+		count_vm_events(NUMA_PTE_UPDATES, pages);
+	}
+	return pages;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Check if all pages in a range are on a set of nodes.
  * If pagelist != NULL then isolate pages from the LRU and
@@ -625,7 +737,10 @@ static int policy_vma(struct vm_area_struct *vma, struct mempolicy *new)
 		err = vma->vm_ops->set_policy(vma, new);
 	if (!err) {
 		mpol_get(new);
+		/* see spf_anonymous_page() */
+		vm_write_begin(vma);
 		vma->vm_policy = new;
+		vm_write_end(vma);
 		mpol_put(old);
 	}
 	return err;
@@ -1987,6 +2102,66 @@ int __mpol_equal(struct mempolicy *a, struct mempolicy *b)
 	}
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/**
+ * mpol_misplaced - check whether a page is on the node its policy wants
+ * @page: page taking a NUMA hinting fault
+ * @vma: vma it is mapped into
+ * @addr: faulting address
+ *
+ * The default policy wants pages on the node of the task touching them;
+ * explicit policies are honoured, so that automatic placement never
+ * moves a page where an allocation could not have put it.
+ *
+ * Returns the node the page should be moved to, or -1 if it is fine
+ * where it is.  Called with mmap_sem held for read.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int thisnid = numa_node_id();
+	int polnid = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+
+	switch (pol->mode) {
+	case MPOL_INTERLEAVE:
+		polnid = offset_il_node(pol, vma, ((addr - vma->vm_start) >>
+				PAGE_SHIFT) + vma->vm_pgoff);
+		break;
+
+	case MPOL_PREFERRED:
+		if (pol->flags & MPOL_F_LOCAL)
+			polnid = thisnid;
+		else
+			polnid = pol->v.preferred_node;
+		break;
+
+	case MPOL_BIND:
+		/* Stay within the mask, moving closer if we may */
+		if (node_isset(curnid, pol->v.nodes) &&
+		    !node_isset(thisnid, pol->v.nodes))
+			break;
+		if (node_isset(thisnid, pol->v.nodes))
+			polnid = thisnid;
+		else
+			polnid = first_node(pol->v.nodes);
+		break;
+
+	default:
+		BUG();
+	}
+	mpol_cond_put(pol);
+
+	if (polnid < 0 || polnid == curnid ||
+	    !node_state(polnid, N_HIGH_MEMORY))
+		return -1;
+	return polnid;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Shared memory backing store policy support.
  *
@@ -1332,6 +1332,82 @@ out:
 	return err;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Don't let automatic placement push a node into reclaim: the target
+ * must stay above its high watermarks with the new pages in place.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
+				   int nr_migrate_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+		if (zone->all_unreclaimable)
+			continue;
+		if (zone_watermark_ok(zone, 0,
+				      high_wmark_pages(zone) + nr_migrate_pages,
+				      0, 0))
+			return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long node, int **result)
+{
+	return alloc_pages_exact_node((int)node,
+			(GFP_HIGHUSER_MOVABLE | __GFP_THISNODE |
+			 __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN) &
+			~__GFP_WAIT, 0);
+}
+
+/**
+ * migrate_misplaced_page - move a page after a NUMA hinting fault
+ * @page: page to move, on which the caller holds a reference
+ * @node: node to move it to
+ *
+ * Pages mapped by more than one process are left alone, as they would
+ * just bounce between the nodes of their users.  The migration does
+ * not wait for page locks or writeback, so that the faulting task is
+ * not held up: the page will be looked at again after the next scan.
+ *
+ * Drops the caller's reference.  Returns 1 if the page was moved.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	if (page_mapcount(page) != 1 ||
+	    !migrate_balanced_pgdat(NODE_DATA(node), 1))
+		goto out;
+	if (isolate_lru_page(page))
+		goto out;
+
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+	/* isolate_lru_page() took its own reference */
+	put_page(page);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, false);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+out:
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Call migration functions in the vma_ops that may prepare
  * memory in a vm for migration. migration functions may perform
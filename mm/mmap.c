@@ -224,6 +224,36 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static void vma_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(vm_area_cachep,
+			container_of(head, struct vm_area_struct, vm_rcu));
+}
+#endif
+
+/*
+ * Drop a reference to a vma that is no longer in the mm and free it
+ * with the last one.  Speculative page faults may hold references of
+ * their own, and look vmas up under rcu_read_lock(), so the memory
+ * itself is only given back after a grace period.
+ */
+void put_vma(struct vm_area_struct *vma)
+{
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	if (!atomic_dec_and_test(&vma->vm_ref_count))
+		return;
+#endif
+	if (vma->vm_file)
+		fput(vma->vm_file);
+	mpol_put(vma_policy(vma));
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	call_rcu(&vma->vm_rcu, vma_free_rcu);
+#else
+	kmem_cache_free(vm_area_cachep, vma);
+#endif
+}
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -234,13 +264,9 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file) {
-		fput(vma->vm_file);
-		if (vma->vm_flags & VM_EXECUTABLE)
-			removed_exe_file_vma(vma->vm_mm);
-	}
-	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	if (vma->vm_file && (vma->vm_flags & VM_EXECUTABLE))
+		removed_exe_file_vma(vma->vm_mm);
+	put_vma(vma);
 	return next;
 }
 
@@ -420,8 +446,20 @@ __vma_link_list(struct mm_struct *mm, struct vm_area_struct *vma,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * The tree holds the first reference, see put_vma().  The sequence
+	 * count is zeroed or copied along with the rest of a new vma, and
+	 * copy_vma() relies on it staying odd if it links the vma odd.
+	 */
+	atomic_set(&vma->vm_ref_count, 1);
+	write_seqcount_begin(&mm->mm_seq);
+#endif
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	write_seqcount_end(&mm->mm_seq);
+#endif
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -504,7 +542,13 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	write_seqcount_begin(&mm->mm_seq);
+#endif
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	write_seqcount_end(&mm->mm_seq);
+#endif
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 }
@@ -514,10 +558,12 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
  * is already present in an i_mmap tree without adjusting the tree.
  * The following helper function should be used when such adjustments
  * are necessary.  The "insert" vma (if any) is to be inserted
- * before we drop the necessary locks.
+ * before we drop the necessary locks.  With @keep, @vma is left between
+ * vm_write_begin() and vm_write_end() on return, for the caller to end.
  */
-int vma_adjust(struct vm_area_struct *vma, unsigned long start,
-	unsigned long end, pgoff_t pgoff, struct vm_area_struct *insert)
+static int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
+	unsigned long end, pgoff_t pgoff, struct vm_area_struct *insert,
+	bool keep)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	struct vm_area_struct *next = vma->vm_next;
@@ -617,6 +663,9 @@ again:			remove_next = 1 + (end > next->vm_end);
 			vma_prio_tree_remove(next, root);
 	}
 
+	vm_write_begin(vma);
+	if (adjust_next || remove_next)
+		vm_write_begin(next);
 	vma->vm_start = start;
 	vma->vm_end = end;
 	vma->vm_pgoff = pgoff;
@@ -649,22 +698,24 @@ again:			remove_next = 1 + (end > next->vm_end);
 		__insert_vm_struct(mm, insert);
 	}
 
+	/* a removed next is left marked as changing */
+	if (adjust_next)
+		vm_write_end(next);
+	if (!keep || remove_next == 2)
+		vm_write_end(vma);
+
 	if (anon_vma)
 		anon_vma_unlock(anon_vma);
 	if (mapping)
 		spin_unlock(&mapping->i_mmap_lock);
 
 	if (remove_next) {
-		if (file) {
-			fput(file);
-			if (next->vm_flags & VM_EXECUTABLE)
-				removed_exe_file_vma(mm);
-		}
+		if (file && (next->vm_flags & VM_EXECUTABLE))
+			removed_exe_file_vma(mm);
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
-		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -681,6 +732,12 @@ again:			remove_next = 1 + (end > next->vm_end);
 	return 0;
 }
 
+int vma_adjust(struct vm_area_struct *vma, unsigned long start,
+	unsigned long end, pgoff_t pgoff, struct vm_area_struct *insert)
+{
+	return __vma_adjust(vma, start, end, pgoff, insert, false);
+}
+
 /*
  * If the vma has a ->close operation then the driver probably needs to release
  * per-vma resources, so we don't attempt to merge those.
@@ -776,12 +833,15 @@ can_vma_merge_after(struct vm_area_struct *vma, unsigned long vm_flags,
  *
  * Odd one out? Case 8, because it extends NNNN but needs flags of XXXX:
  * mprotect_fixup updates vm_flags & vm_page_prot on successful return.
+ *
+ * With @keep, which only a merge into a hole (cases 1, 2 and 3) may ask
+ * for, the vma returned is left for the caller to vm_write_end().
  */
-struct vm_area_struct *vma_merge(struct mm_struct *mm,
+static struct vm_area_struct *__vma_merge(struct mm_struct *mm,
 			struct vm_area_struct *prev, unsigned long addr,
 			unsigned long end, unsigned long vm_flags,
 		     	struct anon_vma *anon_vma, struct file *file,
-			pgoff_t pgoff, struct mempolicy *policy)
+			pgoff_t pgoff, struct mempolicy *policy, bool keep)
 {
 	pgoff_t pglen = (end - addr) >> PAGE_SHIFT;
 	struct vm_area_struct *area, *next;
@@ -819,11 +879,11 @@ struct vm_area_struct *vma_merge(struct mm_struct *mm,
 				is_mergeable_anon_vma(prev->anon_vma,
 						      next->anon_vma)) {
 							/* cases 1, 6 */
-			err = vma_adjust(prev, prev->vm_start,
-				next->vm_end, prev->vm_pgoff, NULL);
+			err = __vma_adjust(prev, prev->vm_start,
+				next->vm_end, prev->vm_pgoff, NULL, keep);
 		} else					/* cases 2, 5, 7 */
-			err = vma_adjust(prev, prev->vm_start,
-				end, prev->vm_pgoff, NULL);
+			err = __vma_adjust(prev, prev->vm_start,
+				end, prev->vm_pgoff, NULL, keep);
 		if (err)
 			return NULL;
 		khugepaged_enter_vma_merge(prev);
@@ -837,12 +897,13 @@ struct vm_area_struct *vma_merge(struct mm_struct *mm,
  			mpol_equal(policy, vma_policy(next)) &&
 			can_vma_merge_before(next, vm_flags,
 					anon_vma, file, pgoff+pglen)) {
-		if (prev && addr < prev->vm_end)	/* case 4 */
+		if (prev && addr < prev->vm_end) {	/* case 4 */
+			VM_BUG_ON(keep);
 			err = vma_adjust(prev, prev->vm_start,
 				addr, prev->vm_pgoff, NULL);
-		else					/* cases 3, 8 */
-			err = vma_adjust(area, addr, next->vm_end,
-				next->vm_pgoff - pglen, NULL);
+		} else					/* cases 3, 8 */
+			err = __vma_adjust(area, addr, next->vm_end,
+				next->vm_pgoff - pglen, NULL, keep);
 		if (err)
 			return NULL;
 		khugepaged_enter_vma_merge(area);
@@ -852,6 +913,16 @@ struct vm_area_struct *vma_merge(struct mm_struct *mm,
 	return NULL;
 }
 
+struct vm_area_struct *vma_merge(struct mm_struct *mm,
+			struct vm_area_struct *prev, unsigned long addr,
+			unsigned long end, unsigned long vm_flags,
+		     	struct anon_vma *anon_vma, struct file *file,
+			pgoff_t pgoff, struct mempolicy *policy)
+{
+	return __vma_merge(mm, prev, addr, end, vm_flags, anon_vma, file,
+			   pgoff, policy, false);
+}
+
 /*
  * Rough compatbility check to quickly see if it's even worth looking
  * at sharing an anon_vma.
@@ -1588,6 +1659,13 @@ get_unmapped_area(struct file *file, unsigned long addr, unsigned long len,
 	get_area = current->mm->get_unmapped_area;
 	if (file && file->f_op && file->f_op->get_unmapped_area)
 		get_area = file->f_op->get_unmapped_area;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	else if (!file && (flags & MAP_SHARED)) {
+		/* shared anonymous memory is shmem, see shmem_zero_setup() */
+		get_area = shmem_get_unmapped_area;
+		pgoff = 0;
+	}
+#endif
 	addr = get_area(file, addr, len, pgoff, flags);
 	if (IS_ERR_VALUE(addr))
 		return addr;
@@ -1640,6 +1718,59 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Look up the vma containing @addr without mmap_sem, for a speculative
+ * page fault.  The walk may race with changes to the tree: they are
+ * caught by mm_seq, and the depth of the walk is bounded in case a
+ * concurrent rotation sends it in circles.  On success a reference to
+ * the vma is returned, to be dropped with put_vma(), and @seq is set
+ * to its sequence count for the caller to revalidate the vma against.
+ */
+struct vm_area_struct *get_vma_speculative(struct mm_struct *mm,
+					unsigned long addr, unsigned int *seq)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+	unsigned int mm_seq;
+	int depth = 0;
+
+	rcu_read_lock();
+	mm_seq = read_seqcount_begin(&mm->mm_seq);
+
+	rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	while (rb_node && depth++ < 2 * BITS_PER_LONG) {
+		struct vm_area_struct *vma_tmp;
+
+		vma_tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (ACCESS_ONCE(vma_tmp->vm_end) > addr) {
+			vma = vma_tmp;
+			if (ACCESS_ONCE(vma_tmp->vm_start) <= addr)
+				break;
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		} else
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+	}
+
+	if (!vma || !atomic_inc_not_zero(&vma->vm_ref_count)) {
+		rcu_read_unlock();
+		return NULL;
+	}
+
+	*seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if ((*seq & 1) || read_seqcount_retry(&mm->mm_seq, mm_seq) ||
+	    vma->vm_start > addr || vma->vm_end <= addr) {
+		rcu_read_unlock();
+		put_vma(vma);
+		return NULL;
+	}
+	rcu_read_unlock();
+
+	return vma;
+}
+#endif
+
 /* Same as find_vma, but also return a pointer to the previous VMA in *pprev. */
 struct vm_area_struct *
 find_vma_prev(struct mm_struct *mm, unsigned long addr,
@@ -1940,12 +2071,20 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	write_seqcount_begin(&mm->mm_seq);
+#endif
 	do {
+		/* never ended: speculative faults must back off for good */
+		vm_write_begin(vma);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
 	} while (vma && vma->vm_start < end);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	write_seqcount_end(&mm->mm_seq);
+#endif
 	*insertion_point = vma;
 	if (vma)
 		vma->vm_prev = prev;
@@ -2347,6 +2486,9 @@ int insert_vm_struct(struct mm_struct * mm, struct vm_area_struct * vma)
 /*
  * Copy the vma structure to a new location in the same mm,
  * prior to moving page table entries, to effect an mremap move.
+ * The vma returned is already marked as changing, so that no speculative
+ * fault maps a page in its range before the entries have moved: the
+ * caller vm_write_end()s it when done.
  */
 struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 	unsigned long addr, unsigned long len, pgoff_t pgoff)
@@ -2366,8 +2508,8 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 		pgoff = addr >> PAGE_SHIFT;
 
 	find_vma_prepare(mm, addr, &prev, &rb_link, &rb_parent);
-	new_vma = vma_merge(mm, prev, addr, addr + len, vma->vm_flags,
-			vma->anon_vma, vma->vm_file, pgoff, vma_policy(vma));
+	new_vma = __vma_merge(mm, prev, addr, addr + len, vma->vm_flags,
+			vma->anon_vma, vma->vm_file, pgoff, vma_policy(vma), true);
 	if (new_vma) {
 		/*
 		 * Source vma may have been merged into new_vma
@@ -2396,6 +2538,7 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 			}
 			if (new_vma->vm_ops && new_vma->vm_ops->open)
 				new_vma->vm_ops->open(new_vma);
+			vm_write_begin(new_vma);
 			vma_link(mm, new_vma, prev, rb_link, rb_parent);
 		}
 	}
@@ -20,13 +20,17 @@
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
- * memset *ra to zero.
+ * memset *ra to zero, but not every caller does: clear the access history,
+ * or a stale stride would be taken for a strided stream.
  */
 void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = mapping->backing_dev_info->ra_pages;
 	ra->prev_pos = -1;
+	memset(ra->history, 0, sizeof(ra->history));
+	ra->history_idx = 0;
+	ra->stride = 0;
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
@@ -171,7 +175,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_cold(mapping);
@@ -189,8 +193,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		count_vm_events(READAHEAD_PAGES, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -277,10 +283,8 @@ static unsigned long get_init_ra_size(unsigned long size, unsigned long max)
  *  Get the previous window size, ramp it up, and
  *  return it as the new window size.
  */
-static unsigned long get_next_ra_size(struct file_ra_state *ra,
-						unsigned long max)
+static unsigned long get_next_ra_size(unsigned long cur, unsigned long max)
 {
-	unsigned long cur = ra->size;
 	unsigned long newsize;
 
 	if (cur < max / 16)
@@ -328,8 +332,83 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
  * it approaches max_readhead.
+ *
+ * The offsets of the last RA_HISTORY cache misses are remembered as well.
+ * When they are a constant stride apart, the reader is skipping through the
+ * file in fixed steps, or reading it backward, and the window above would
+ * either read the gaps or nothing at all.  Such a stream is read ahead in
+ * batches of chunks instead: one chunk per step, as big as the reads, or as
+ * the step when reading backward without gaps.  The fields then describe
+ * the last batch:
+ *
+ *     |<- async_size ->|
+ *     |################|.........|################|.........|####...
+ *     ^start            <-------- stride -------->
+ *
+ * size is the number of pages in the batch, which ramps up like a window,
+ * and the first page of the first chunk carries PG_readahead, so that the
+ * next batch is submitted as soon as the reader gets to this one.  A
+ * backward stream without gaps is read as one contiguous range, ending with
+ * the chunk at start.
  */
 
+/*
+ * Remember @offset, where a read missed the page cache, and return the
+ * stride between the last RA_HISTORY misses if it is constant, or 0.
+ */
+static long ra_miss_stride(struct file_ra_state *ra, pgoff_t offset)
+{
+	unsigned int i, oldest;
+	long stride;
+
+	ra->history[ra->history_idx++ % RA_HISTORY] = offset;
+	if (ra->history_idx < RA_HISTORY)
+		return 0;
+
+	/* The slot to be written next holds the oldest miss */
+	oldest = ra->history_idx;
+	stride = ra->history[(oldest + 1) % RA_HISTORY] -
+		 ra->history[oldest % RA_HISTORY];
+	for (i = 2; i < RA_HISTORY; i++)
+		if (ra->history[(oldest + i) % RA_HISTORY] -
+		    ra->history[(oldest + i - 1) % RA_HISTORY] != stride)
+			return 0;
+
+	return stride;
+}
+
+/*
+ * Submit a batch of strided readahead: @size pages in chunks of @chunk
+ * pages, @stride pages apart, starting at @start.
+ */
+static unsigned long ra_submit_strided(struct address_space *mapping,
+		struct file *filp, pgoff_t start, unsigned long size,
+		unsigned long chunk, long stride)
+{
+	unsigned long nr = size / chunk;
+	unsigned long actual = 0;
+	pgoff_t first = start;
+
+	if (stride < 0) {
+		/* Don't run off the start of the file */
+		nr = min(nr, start / -stride + 1);
+
+		if (-stride == chunk) {
+			first = start - (nr - 1) * chunk;
+			return __do_page_cache_readahead(mapping, filp,
+						first, nr * chunk, chunk);
+		}
+	}
+
+	while (nr--) {
+		actual += __do_page_cache_readahead(mapping, filp,
+				start, chunk, start == first ? chunk : 0);
+		start += stride;
+	}
+
+	return actual;
+}
+
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
  * this count is a conservative estimation of
@@ -343,7 +422,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -393,6 +472,34 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long actual = 0;
+	long stride = 0;
+	/*
+	 * read() and mmap faults update *ra without locking, so the
+	 * strided state is read once and written back as a whole.
+	 */
+	long ra_stride = ACCESS_ONCE(ra->stride);
+	pgoff_t ra_start = ACCESS_ONCE(ra->start);
+	unsigned long ra_size = ACCESS_ONCE(ra->size);
+	unsigned long chunk = ACCESS_ONCE(ra->async_size);
+
+	/*
+	 * The reader got to the first chunk of a strided batch:
+	 * submit the next one, past the last chunk of this one.
+	 */
+	if (hit_readahead_marker && ra_stride && chunk &&
+	    offset >= ra_start && offset < ra_start + chunk) {
+		unsigned long nr = ra_size / chunk;
+
+		if (ra_stride < 0 && ra_start < nr * -ra_stride)
+			return 0;
+		ra_start += (long)nr * ra_stride;
+		ra_size = get_next_ra_size(ra_size, max);
+		goto submit_strided;
+	}
+
+	if (!hit_readahead_marker)
+		stride = ra_miss_stride(ra, offset);
 
 	/*
 	 * start of file
@@ -404,10 +511,11 @@ ondemand_readahead(struct address_space *mapping,
 	 * It's the expected callback offset, assume sequential access.
 	 * Ramp up sizes, and push forward the readahead window.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
+	if (!ra_stride &&
+	    (offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
 		ra->start += ra->size;
-		ra->size = get_next_ra_size(ra, max);
+		ra->size = get_next_ra_size(ra->size, max);
 		ra->async_size = ra->size;
 		goto readit;
 	}
@@ -422,7 +530,7 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
@@ -431,7 +539,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
-		ra->size = get_next_ra_size(ra, max);
+		ra->size = get_next_ra_size(ra->size, max);
 		ra->async_size = ra->size;
 		goto readit;
 	}
@@ -448,6 +556,13 @@ ondemand_readahead(struct address_space *mapping,
 	if (offset - (ra->prev_pos >> PAGE_CACHE_SHIFT) <= 1UL)
 		goto initial_readahead;
 
+	/*
+	 * The last few misses were a constant stride apart: a reader
+	 * skipping through the file, or reading it backward.
+	 */
+	if (stride < 0 || stride > (long)req_size)
+		goto strided_readahead;
+
 	/*
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
@@ -461,19 +576,47 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
+strided_readahead:
+	/* The read itself, then a batch of chunks from the next step on */
+	actual = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	if (stride < 0 && offset < -stride)
+		return actual;
+
+	ra_stride = stride;
+	ra_start = offset + stride;
+	chunk = min_t(unsigned long, req_size, abs(stride));
+	ra_size = get_init_ra_size(chunk, max);
+
+submit_strided:
+	/* Whole chunks only, and at least one */
+	ra_size = max(ra_size - ra_size % chunk, chunk);
+	ra->stride = ra_stride;
+	ra->start = ra_start;
+	ra->size = ra_size;
+	ra->async_size = chunk;
+	if (ra_stride < 0 && -ra_stride == chunk)
+		count_vm_event(READAHEAD_BACKWARD);
+	else
+		count_vm_event(READAHEAD_STRIDE);
+
+	return actual + ra_submit_strided(mapping, filp, ra_start, ra_size,
+					  chunk, ra_stride);
+
 initial_readahead:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
 
 readit:
+	ra->stride = 0;
+
 	/*
 	 * Will this read hit the readahead marker made by itself?
 	 * If so, trigger the readahead marker hit now, and merge
 	 * the resulted next readahead window into the current one.
 	 */
 	if (offset == ra->start && ra->size == ra->async_size) {
-		ra->async_size = get_next_ra_size(ra, max);
+		ra->async_size = get_next_ra_size(ra->size, max);
 		ra->size += ra->async_size;
 	}
 
@@ -502,6 +645,8 @@ void page_cache_sync_readahead(struct address_space *mapping,
 	if (!ra->ra_pages)
 		return;
 
+	count_vm_event(READAHEAD_MISS);
+
 	/* be dumb */
 	if (filp && (filp->f_mode & FMODE_RANDOM)) {
 		force_page_cache_readahead(mapping, filp, offset, req_size);
@@ -552,6 +697,8 @@ page_cache_async_readahead(struct address_space *mapping,
 	if (bdi_read_congested(mapping->backing_dev_info))
 		return;
 
+	count_vm_event(READAHEAD_HIT);
+
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, true, offset, req_size);
 
@@ -60,11 +60,15 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/mm_inline.h>
+#include <linux/kobject.h>
 
 #include <asm/uaccess.h>
 #include <asm/div64.h>
 #include <asm/pgtable.h>
 
+#include "internal.h"
+
 /*
  * The maximum size of a shmem/tmpfs file is limited by the maximum size of
  * its triple-indirect swap vector - see illustration at shmem_swp_entry().
@@ -105,6 +109,7 @@ enum sgp_type {
 	SGP_CACHE,	/* don't exceed i_size, may allocate page */
 	SGP_DIRTY,	/* like SGP_CACHE, but set new page dirty */
 	SGP_WRITE,	/* may exceed i_size, may allocate page */
+	SGP_HUGE,	/* like SGP_CACHE, but allocate a whole extent */
 };
 
 #ifdef CONFIG_TMPFS
@@ -1181,6 +1186,22 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 	 */
 	return alloc_page_vma(gfp, &pvma, 0);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, unsigned long hindex)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = hindex;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, hindex);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0);
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *p)
@@ -1199,6 +1220,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, unsigned long hindex)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -1208,6 +1237,193 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Huge pages in shmem are extents: HPAGE_PMD_NR naturally aligned page
+ * cache pages which happen to be physically contiguous, because they
+ * were allocated together as one high order page and then split.  Each
+ * page is still accounted, locked, swapped and truncated on its own;
+ * shared mappings of a complete extent are mapped with a huge pmd (see
+ * do_huge_pmd_shmem_page), and khugepaged can migrate the pages of an
+ * incomplete one into place.
+ *
+ * Mounts choose when to allocate extents with huge=; shmem_huge is the
+ * policy of the internal mount used for SysV shm and shared anonymous
+ * memory, or SHMEM_HUGE_DENY/FORCE to override every mount.
+ */
+static int shmem_huge __read_mostly;
+
+static const char *shmem_huge_names[] = {
+	[SHMEM_HUGE_NEVER]	= "never",
+	[SHMEM_HUGE_ALWAYS]	= "always",
+	[SHMEM_HUGE_WITHIN_SIZE] = "within_size",
+	[SHMEM_HUGE_ADVISE]	= "advise",
+};
+
+static int shmem_parse_huge(const char *str)
+{
+	int huge;
+
+	for (huge = 0; huge < ARRAY_SIZE(shmem_huge_names); huge++)
+		if (!strcmp(str, shmem_huge_names[huge]))
+			return huge;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	if (huge == SHMEM_HUGE_DENY)
+		return "deny";
+	if (huge == SHMEM_HUGE_FORCE)
+		return "force";
+	return shmem_huge_names[huge];
+}
+
+static pgoff_t shmem_size_pages(struct inode *inode)
+{
+	return (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+}
+
+/* Should the extent at @hindex be allocated for a shmem_getpage(@sgp)? */
+static bool shmem_huge_allowed(struct inode *inode, unsigned long hindex,
+			       enum sgp_type sgp)
+{
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return hindex + HPAGE_PMD_NR <= shmem_size_pages(inode);
+	case SHMEM_HUGE_ADVISE:
+		/* only on behalf of a MADV_HUGEPAGE mapping */
+		return sgp == SGP_HUGE;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Try to populate the whole extent around @idx at once.  Indices which
+ * are swapped out or which something else fills meanwhile are skipped,
+ * the pages meant for them freed.  Returns the number of pages added;
+ * they are left unlocked and clean, like hole pages, so the caller has
+ * to look its page up again.
+ */
+static int shmem_alloc_extent(struct inode *inode, unsigned long idx,
+			      enum sgp_type sgp, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	unsigned long hindex = idx & ~((unsigned long)HPAGE_PMD_NR - 1);
+	struct page *page, *probe;
+	swp_entry_t *entry;
+	unsigned long swapped;
+	int i, added = 0;
+
+	if (sgp != SGP_CACHE && sgp != SGP_WRITE && sgp != SGP_HUGE)
+		return 0;
+	if (!shmem_huge_allowed(inode, hindex, sgp))
+		return 0;
+	/* Only beyond i_size when writing may extend the file */
+	if (sgp != SGP_WRITE && hindex + HPAGE_PMD_NR > shmem_size_pages(inode))
+		return 0;
+	/* An extent with pages in it already could not end up contiguous */
+	if (find_get_pages(mapping, hindex, 1, &probe)) {
+		pgoff_t index = probe->index;
+
+		page_cache_release(probe);
+		if (index < hindex + HPAGE_PMD_NR)
+			return 0;
+	}
+
+	page = shmem_alloc_hugepage(gfp | __GFP_NORETRY | __GFP_NOWARN,
+				    info, hindex);
+	if (!page)
+		return 0;
+	split_page(page, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *subpage = page + i;
+
+		clear_highpage(subpage);
+		flush_dcache_page(subpage);
+		SetPageUptodate(subpage);
+		SetPageSwapBacked(subpage);
+		if (mem_cgroup_cache_charge(subpage, current->mm, GFP_KERNEL))
+			break;
+
+		spin_lock(&info->lock);
+		if (sbinfo->max_blocks) {
+			if (percpu_counter_compare(&sbinfo->used_blocks,
+						   sbinfo->max_blocks) > 0 ||
+			    shmem_acct_block(info->flags))
+				goto nospace;
+			percpu_counter_inc(&sbinfo->used_blocks);
+			spin_lock(&inode->i_lock);
+			inode->i_blocks += BLOCKS_PER_PAGE;
+			spin_unlock(&inode->i_lock);
+		} else if (shmem_acct_block(info->flags))
+			goto nospace;
+
+		entry = shmem_swp_alloc(info, hindex + i, sgp);
+		if (IS_ERR(entry)) {
+			spin_unlock(&info->lock);
+			shmem_unacct_blocks(info->flags, 1);
+			shmem_free_blocks(inode, 1);
+			mem_cgroup_uncharge_cache_page(subpage);
+			break;
+		}
+		swapped = entry->val;
+		shmem_swp_unmap(entry);
+		if (swapped) {
+			mem_cgroup_uncharge_cache_page(subpage);
+			goto skip;
+		}
+		/* At add_to_page_cache_lru() failure, uncharge is automatic */
+		if (add_to_page_cache_lru(subpage, mapping, hindex + i,
+					  GFP_NOWAIT))
+			goto skip;
+		info->flags |= SHMEM_PAGEIN;
+		info->alloced++;
+		spin_unlock(&info->lock);
+		unlock_page(subpage);
+		page_cache_release(subpage);
+		added++;
+		continue;
+skip:
+		spin_unlock(&info->lock);
+		shmem_unacct_blocks(info->flags, 1);
+		shmem_free_blocks(inode, 1);
+		page_cache_release(subpage);
+		continue;
+nospace:
+		spin_unlock(&info->lock);
+		mem_cgroup_uncharge_cache_page(subpage);
+		break;
+	}
+
+	/* Free what is left after a hard error */
+	for (; i < HPAGE_PMD_NR; i++)
+		page_cache_release(page + i);
+	return added;
+}
+#else /* !CONFIG_TRANSPARENT_HUGEPAGE */
+static inline int shmem_alloc_extent(struct inode *inode, unsigned long idx,
+				     enum sgp_type sgp, gfp_t gfp)
+{
+	return 0;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage - either get the page from swap or allocate a new one
  *
@@ -1227,6 +1443,7 @@ static int shmem_getpage(struct inode *inode, unsigned long idx,
 	swp_entry_t *entry;
 	swp_entry_t swap;
 	gfp_t gfp;
+	int extent_tried = 0;
 	int error;
 
 	if (idx >= SHMEM_MAX_INDEX)
@@ -1249,6 +1466,11 @@ repeat:
 	if (filepage && PageUptodate(filepage))
 		goto done;
 	gfp = mapping_gfp_mask(mapping);
+	if (!filepage && !extent_tried) {
+		extent_tried = 1;
+		if (shmem_alloc_extent(inode, idx, sgp, gfp))
+			goto repeat;
+	}
 	if (!filepage) {
 		/*
 		 * Try to preload while we can wait, to not make a habit of
@@ -1506,6 +1728,150 @@ out:
 	return error;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/**
+ * shmem_huge_extent - get a complete extent for mapping with a huge pmd
+ * @vma: shared mapping of a shmem file
+ * @hindex: HPAGE_PMD_NR aligned page index in the file
+ *
+ * Allocates the extent if the policy allows.  Returns its first page
+ * with every page of the extent locked and referenced, or NULL if the
+ * extent is not complete and physically contiguous.
+ */
+struct page *shmem_huge_extent(struct vm_area_struct *vma, pgoff_t hindex)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct page *head = NULL, *page;
+	int i = 1;	/* pages locked and referenced, from head on */
+
+	if (hindex + HPAGE_PMD_NR > shmem_size_pages(inode))
+		return NULL;
+	if (shmem_getpage(inode, hindex, &head, SGP_HUGE, NULL))
+		return NULL;
+	if (page_to_pfn(head) & (HPAGE_PMD_NR - 1))
+		goto fail;
+
+	for (; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, hindex + i);
+		if (!page)
+			goto fail;
+		if (page_to_pfn(page) != page_to_pfn(head) + i ||
+		    !trylock_page(page)) {
+			page_cache_release(page);
+			goto fail;
+		}
+		if (page->mapping != mapping || !PageUptodate(page)) {
+			unlock_page(page);
+			page_cache_release(page);
+			goto fail;
+		}
+	}
+	return head;
+
+fail:
+	while (i--) {
+		unlock_page(head + i);
+		page_cache_release(head + i);
+	}
+	return NULL;
+}
+
+struct shmem_collapse_control {
+	struct page *target;
+	pgoff_t hindex;
+	DECLARE_BITMAP(used, HPAGE_PMD_NR);
+};
+
+static struct page *shmem_collapse_newpage(struct page *page,
+					   unsigned long private, int **result)
+{
+	struct shmem_collapse_control *cc = (void *)private;
+	pgoff_t offset = page->index - cc->hindex;
+
+	/*
+	 * Each target page is handed out once: a retried migration has
+	 * freed it already, and gets NULL so that the collapse is given up.
+	 */
+	if (offset >= HPAGE_PMD_NR || test_and_set_bit(offset, cc->used))
+		return NULL;
+	return cc->target + offset;
+}
+
+/**
+ * shmem_collapse_extent - make an extent physically contiguous
+ * @inode: shmem inode
+ * @hindex: HPAGE_PMD_NR aligned page index in the file
+ *
+ * Called by khugepaged when every page of the extent is in the page
+ * cache.  Pages which are not in place are migrated into a new high
+ * order allocation.  Returns 1 if the extent is contiguous now.
+ */
+int shmem_collapse_extent(struct inode *inode, pgoff_t hindex)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_collapse_control *cc;
+	struct page **pages;
+	LIST_HEAD(pagelist);
+	int i, nr, isolated = 0, ret = 0;
+
+	pages = kmalloc(HPAGE_PMD_NR * sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return 0;
+	nr = find_get_pages_contig(mapping, hindex, HPAGE_PMD_NR, pages);
+	if (nr < HPAGE_PMD_NR)
+		goto out;
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (page_to_pfn(pages[i]) != page_to_pfn(pages[0]) + i)
+			break;
+	if (i == HPAGE_PMD_NR && !(page_to_pfn(pages[0]) & (HPAGE_PMD_NR - 1))) {
+		ret = 1;
+		goto out;
+	}
+
+	cc = kzalloc(sizeof(*cc), GFP_KERNEL);
+	if (!cc)
+		goto out;
+	cc->hindex = hindex;
+	cc->target = shmem_alloc_hugepage(mapping_gfp_mask(mapping) |
+					  __GFP_NORETRY | __GFP_NOWARN,
+					  SHMEM_I(inode), hindex);
+	if (!cc->target)
+		goto out_free;
+	split_page(cc->target, HPAGE_PMD_ORDER);
+
+	lru_add_drain();
+	for (isolated = 0; isolated < HPAGE_PMD_NR; isolated++) {
+		struct page *page = pages[isolated];
+
+		if (isolate_lru_page(page))
+			break;
+		list_add_tail(&page->lru, &pagelist);
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		/* migration wants the isolation reference only */
+		page_cache_release(page);
+	}
+	if (isolated == HPAGE_PMD_NR &&
+	    !migrate_pages(&pagelist, shmem_collapse_newpage,
+			   (unsigned long)cc, false, true))
+		ret = 1;
+	/* whatever was not migrated */
+	putback_lru_pages(&pagelist);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (!test_bit(i, cc->used))
+			__free_page(cc->target + i);
+out_free:
+	kfree(cc);
+out:
+	for (i = isolated; i < nr; i++)
+		page_cache_release(pages[i]);
+	kfree(pages);
+	return ret;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
@@ -1574,6 +1940,89 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+/* Also true for SysV shm, whose files share the shmem mapping */
+bool vma_is_shmem(struct vm_area_struct *vma)
+{
+	return vma->vm_file && vma->vm_file->f_mapping->a_ops == &shmem_aops;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/**
+ * shmem_huge_enabled - may this mapping use huge pmds
+ * @vma: the mapping
+ *
+ * Only shared mappings are mapped with huge pmds: a private one would
+ * have to break every extent up on its first copy on write.
+ */
+int shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode;
+
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    (vma->vm_flags & (VM_NOHUGEPAGE | VM_NONLINEAR)) ||
+	    !vma_is_shmem(vma))
+		return 0;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return 1;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return 0;
+
+	inode = vma->vm_file->f_mapping->host;
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return 1;
+	case SHMEM_HUGE_ADVISE:
+		return !!(vma->vm_flags & VM_HUGEPAGE);
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Place mappings which are big enough so that their file offsets and
+ * virtual addresses agree modulo HPAGE_PMD_SIZE, which huge pmds need.
+ */
+unsigned long shmem_get_unmapped_area(struct file *file, unsigned long addr,
+				      unsigned long len, unsigned long pgoff,
+				      unsigned long flags)
+{
+	unsigned long (*get_area)(struct file *, unsigned long,
+				  unsigned long, unsigned long, unsigned long);
+	unsigned long offset, inflated_len, inflated_addr;
+	struct super_block *sb;
+
+	get_area = current->mm->get_unmapped_area;
+	addr = get_area(file, addr, len, pgoff, flags);
+	if (IS_ERR_VALUE(addr) || (flags & MAP_FIXED))
+		return addr;
+	if (!(flags & MAP_SHARED) || len < HPAGE_PMD_SIZE)
+		return addr;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return addr;
+	if (shmem_huge != SHMEM_HUGE_FORCE) {
+		/* shared anonymous memory gets its file later */
+		sb = file ? file->f_mapping->host->i_sb : shm_mnt->mnt_sb;
+		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+			return addr;
+	}
+
+	offset = (pgoff << PAGE_SHIFT) & ~HPAGE_PMD_MASK;
+	if ((addr & ~HPAGE_PMD_MASK) == offset)
+		return addr;
+
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len < len)
+		return addr;
+	inflated_addr = get_area(NULL, 0, inflated_len, 0, flags);
+	if (IS_ERR_VALUE(inflated_addr))
+		return addr;
+
+	inflated_addr += (offset - inflated_addr) & ~HPAGE_PMD_MASK;
+	return inflated_addr;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 static struct inode *shmem_get_inode(struct super_block *sb, const struct inode *dir,
 				     int mode, dev_t dev, unsigned long flags)
 {
@@ -2250,6 +2699,14 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char, "huge")) {
+			int huge = shmem_parse_huge(value);
+			/* deny and force are only for the global knob */
+			if (huge < 0)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2296,6 +2753,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2319,6 +2777,10 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2465,6 +2927,9 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.get_unmapped_area = shmem_get_unmapped_area,
+#endif
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2596,6 +3061,57 @@ out4:
 	return error;
 }
 
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && defined(CONFIG_SYSFS)
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	static const int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(values); i++)
+		count += sprintf(buf + count,
+				 shmem_huge == values[i] ? "[%s] " : "%s ",
+				 shmem_format_huge(values[i]));
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	/* the internal mount follows the global policy */
+	if (huge >= SHMEM_HUGE_NEVER && !IS_ERR(shm_mnt))
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE && CONFIG_SYSFS */
+
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 /**
  * mem_cgroup_get_shmem_target - find a page or entry assigned to the shmem file
@@ -2706,6 +3222,15 @@ out:
 #define shmem_unacct_size(flags, size)		do {} while (0)
 #define SHMEM_MAX_BYTES				MAX_LFS_FILESIZE
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+unsigned long shmem_get_unmapped_area(struct file *file, unsigned long addr,
+				      unsigned long len, unsigned long pgoff,
+				      unsigned long flags)
+{
+	return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+#endif
+
 #endif /* CONFIG_SHMEM */
 
 /* common code */
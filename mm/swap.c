@@ -39,6 +39,7 @@ int page_cluster;
 
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -200,7 +201,10 @@ static void pagevec_move_tail(struct pagevec *pvec)
 		}
 		if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 			int lru = page_lru_base_type(page);
-			list_move_tail(&page->lru, &zone->lru[lru].list);
+			struct lruvec *lruvec;
+
+			lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
+			list_move_tail(&page->lru, &lruvec->lists[lru]);
 			pgmoved++;
 		}
 	}
@@ -275,6 +279,57 @@ void activate_page(struct page *page)
 	spin_unlock_irq(&zone->lru_lock);
 }
 
+static void pagevec_lazyfree(struct pagevec *pvec)
+{
+	int i;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+		    !PageSwapCache(page) && !PageUnevictable(page)) {
+			del_page_from_lru_list(zone, page, page_lru(page));
+
+			ClearPageActive(page);
+			ClearPageReferenced(page);
+			ClearPageSwapBacked(page);
+			add_page_to_lru_list(zone, page, LRU_INACTIVE_FILE);
+			__count_vm_event(PGLAZYFREE);
+		}
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/*
+ * Move a clean anonymous page that its owner no longer cares about
+ * (MADV_FREE) to the inactive file list.  Clearing PG_swapbacked tells
+ * reclaim that the page can be discarded rather than swapped out.
+ * The pages are batched per cpu to take the lru_lock once per pagevec.
+ */
+void mark_page_lazyfree(struct page *page)
+{
+	if (PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+	    !PageSwapCache(page) && !PageUnevictable(page)) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_lazyfree(pvec);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 /*
  * Mark a page as having seen activity.
  *
@@ -288,6 +343,7 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -372,6 +428,10 @@ static void drain_cpu_pagevecs(int cpu)
 		pagevec_move_tail(pvec);
 		local_irq_restore(flags);
 	}
+
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lazyfree(pvec);
 }
 
 void lru_add_drain(void)
@@ -486,7 +546,6 @@ void lru_add_page_tail(struct zone* zone,
 	int active;
 	enum lru_list lru;
 	const int file = 0;
-	struct list_head *head;
 
 	VM_BUG_ON(!PageHead(page));
 	VM_BUG_ON(PageCompound(page_tail));
@@ -505,15 +564,21 @@ void lru_add_page_tail(struct zone* zone,
 			lru = LRU_INACTIVE_ANON;
 		}
 		update_page_reclaim_stat(zone, page_tail, file, active);
-		if (likely(PageLRU(page)))
-			head = page->lru.prev;
-		else
-			head = &zone->lru[lru].list;
-		__add_page_to_lru_list(zone, page_tail, lru, head);
 	} else {
 		SetPageUnevictable(page_tail);
-		add_page_to_lru_list(zone, page_tail, LRU_UNEVICTABLE);
+		lru = LRU_UNEVICTABLE;
 	}
+
+	if (likely(PageLRU(page))) {
+		/*
+		 * The tail is charged to the head's memcg; keep it next
+		 * to the head so the LRU order is preserved.
+		 */
+		mem_cgroup_lru_add_list(zone, page_tail, lru);
+		list_add_tail(&page_tail->lru, &page->lru);
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru, 1);
+	} else
+		add_page_to_lru_list(zone, page_tail, lru);
 }
 
 /*
@@ -182,6 +182,56 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Drop the shadow entries that reclaimed pages left in the range.  No
+ * pages are left there, so no new shadows can appear behind our back.
+ */
+static void truncate_shadow_entries(struct address_space *mapping,
+				    pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i, nr;
+
+	while (mapping->nrshadows && start <= end) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, start, PAGEVEC_SIZE);
+		/*
+		 * Deleting may shrink the tree and move the slots around,
+		 * so only the indices are used once we start.
+		 */
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			struct radix_tree_node *node;
+			void **slot;
+			void *entry;
+
+			entry = __radix_tree_lookup(&mapping->page_tree,
+						    indices[i], &node, &slot);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			radix_tree_replace_slot(slot, NULL);
+			mapping->nrshadows--;
+			if (!node)
+				continue;
+			workingset_node_shadows_dec(node);
+			/* Nodes must be off the shadow list before freeing */
+			if (!workingset_node_shadows(node))
+				workingset_forget_node(node);
+			__radix_tree_delete_node(&mapping->page_tree,
+						 indices[i], node);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (nr < PAGEVEC_SIZE || i < nr)
+			break;
+		start = indices[nr - 1] + 1;
+		if (!start)
+			break;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -215,8 +265,12 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
-	if (mapping->nrpages == 0)
-		return;
+	if (mapping->nrpages == 0) {
+		/* Pairs with the barrier in page_cache_tree_delete() */
+		smp_rmb();
+		if (mapping->nrshadows == 0)
+			return;
+	}
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
@@ -290,6 +344,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		pagevec_release(&pvec);
 		mem_cgroup_uncharge_end();
 	}
+	truncate_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -387,7 +442,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -0,0 +1,255 @@
+/*
+ * mm/vmalloc-test.c
+ *
+ * Stress test for the vmalloc allocator.  A thread per online cpu runs
+ * each test at the same time as the others, so that they contend for the
+ * vmap area tree, the per-cpu area caches and lazy purging, and the time
+ * each test took is reported in the kernel log:
+ *
+ *	modprobe vmalloc-test nr_iterations=100000
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+static int nr_test_threads;
+module_param_named(nr_threads, nr_test_threads, int, 0444);
+MODULE_PARM_DESC(nr_threads, "Number of threads (default: online cpus)");
+
+static int nr_iterations = 10000;
+module_param(nr_iterations, int, 0444);
+MODULE_PARM_DESC(nr_iterations, "Iterations of each test in each thread");
+
+static int max_pages = 32;
+module_param(max_pages, int, 0444);
+MODULE_PARM_DESC(max_pages, "Largest area allocated by the random tests");
+
+#define NR_LIVE_AREAS	64
+
+/* Touch both ends of an area, and see that what was written is there */
+static int check_area(void *addr, unsigned long size, u8 pattern)
+{
+	u8 *p = addr;
+
+	p[0] = pattern;
+	p[size - 1] = pattern;
+	barrier();
+	return (p[0] == pattern && p[size - 1] == pattern) ? 0 : -EFAULT;
+}
+
+static unsigned long random_size(void)
+{
+	return (random32() % max_pages + 1) << PAGE_SHIFT;
+}
+
+/* The same size over and over: served by the per-cpu caches */
+static int fixed_size_test(void)
+{
+	void *addr;
+	int i;
+
+	for (i = 0; i < nr_iterations; i++) {
+		addr = vmalloc(PAGE_SIZE);
+		if (!addr || check_area(addr, PAGE_SIZE, i)) {
+			vfree(addr);
+			return -ENOMEM;
+		}
+		vfree(addr);
+	}
+	return 0;
+}
+
+/* Sizes all over the place: the tree search and purging */
+static int random_size_test(void)
+{
+	unsigned long size;
+	void *addr;
+	int i;
+
+	for (i = 0; i < nr_iterations; i++) {
+		size = random_size();
+		addr = vmalloc(size);
+		if (!addr || check_area(addr, size, i)) {
+			vfree(addr);
+			return -ENOMEM;
+		}
+		vfree(addr);
+	}
+	return 0;
+}
+
+/* Keep many areas alive, replacing one at random: fragmentation */
+static int long_lived_test(void)
+{
+	void **live;
+	unsigned long size;
+	int i, slot, err = 0;
+
+	live = kcalloc(NR_LIVE_AREAS, sizeof(*live), GFP_KERNEL);
+	if (!live)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_iterations; i++) {
+		slot = random32() % NR_LIVE_AREAS;
+		vfree(live[slot]);
+		size = random_size();
+		live[slot] = vmalloc(size);
+		if (!live[slot] || check_area(live[slot], size, i)) {
+			err = -ENOMEM;
+			break;
+		}
+	}
+
+	for (i = 0; i < NR_LIVE_AREAS; i++)
+		vfree(live[i]);
+	kfree(live);
+	return err;
+}
+
+/* vmap() one page many times over: no page allocation, just areas */
+static int vmap_test(void)
+{
+	struct page **pages;
+	struct page *page;
+	unsigned int count;
+	void *addr;
+	int i, err = 0;
+
+	page = alloc_page(GFP_KERNEL);
+	pages = kcalloc(max_pages, sizeof(*pages), GFP_KERNEL);
+	if (!page || !pages) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < max_pages; i++)
+		pages[i] = page;
+
+	for (i = 0; i < nr_iterations; i++) {
+		count = random32() % max_pages + 1;
+		addr = vmap(pages, count, VM_MAP, PAGE_KERNEL);
+		if (!addr || check_area(addr, count << PAGE_SHIFT, i)) {
+			if (addr)
+				vunmap(addr);
+			err = -ENOMEM;
+			break;
+		}
+		vunmap(addr);
+	}
+out:
+	kfree(pages);
+	if (page)
+		__free_page(page);
+	return err;
+}
+
+struct vmalloc_test {
+	const char *name;
+	int (*func)(void);
+	atomic_t failed;
+	atomic64_t usecs;
+};
+
+static struct vmalloc_test tests[] = {
+	{ .name = "fixed_size",	.func = fixed_size_test },
+	{ .name = "random_size", .func = random_size_test },
+	{ .name = "long_lived",	.func = long_lived_test },
+	{ .name = "vmap",	.func = vmap_test },
+};
+
+static atomic_t threads_running;
+static DECLARE_COMPLETION(threads_done);
+
+static int test_thread(void *unused)
+{
+	struct vmalloc_test *t;
+	ktime_t start;
+
+	for (t = tests; t < tests + ARRAY_SIZE(tests); t++) {
+		start = ktime_get();
+		if (t->func())
+			atomic_inc(&t->failed);
+		atomic64_add(ktime_us_delta(ktime_get(), start), &t->usecs);
+		cond_resched();
+	}
+
+	if (atomic_dec_and_test(&threads_running))
+		complete(&threads_done);
+
+	/* Wait for kthread_stop(), so as not to return into freed text */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __init vmalloc_test_init(void)
+{
+	struct task_struct **tasks;
+	struct vmalloc_test *t;
+	int i, started = 0;
+
+	if (nr_test_threads <= 0)
+		nr_test_threads = num_online_cpus();
+	if (max_pages <= 0 || nr_iterations <= 0)
+		return -EINVAL;
+
+	tasks = kcalloc(nr_test_threads, sizeof(*tasks), GFP_KERNEL);
+	if (!tasks)
+		return -ENOMEM;
+
+	pr_info("vmalloc-test: %d threads, %d iterations, up to %d pages\n",
+		nr_test_threads, nr_iterations, max_pages);
+
+	/* Hold a count of our own, so that none completes before all start */
+	atomic_set(&threads_running, 1);
+	for (i = 0; i < nr_test_threads; i++) {
+		atomic_inc(&threads_running);
+		tasks[i] = kthread_run(test_thread, NULL, "vmalloc-test/%d", i);
+		if (IS_ERR(tasks[i])) {
+			atomic_dec(&threads_running);
+			break;
+		}
+		started++;
+	}
+	if (!atomic_dec_and_test(&threads_running))
+		wait_for_completion(&threads_done);
+
+	for (i = 0; i < started; i++)
+		kthread_stop(tasks[i]);
+	kfree(tasks);
+
+	if (!started)
+		return -ENOMEM;
+
+	for (t = tests; t < tests + ARRAY_SIZE(tests); t++)
+		pr_info("vmalloc-test: %-12s %s, %lld usecs per thread\n",
+			t->name, atomic_read(&t->failed) ? "FAILED" : "passed",
+			(long long)div_s64(atomic64_read(&t->usecs), started));
+	return 0;
+}
+module_init(vmalloc_test_init);
+
+static void __exit vmalloc_test_exit(void)
+{
+}
+module_exit(vmalloc_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Stress test for the vmalloc allocator");
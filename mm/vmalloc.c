@@ -255,7 +255,9 @@ struct vmap_area {
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+	struct list_head purge_list;	/* "lazy purge" list, or cached */
+	unsigned long hole;		/* free space below, see vmap_area_hole */
+	unsigned long subtree_max_hole;	/* largest hole in this subtree */
 	void *private;
 	struct rcu_head rcu_head;
 };
@@ -265,6 +267,26 @@ static struct rb_root vmap_area_root = RB_ROOT;
 static LIST_HEAD(vmap_area_list);
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * Each cpu queues the areas it frees on its lazy list until the next
+ * purge.  Once purged, small areas are kept in the cache of the cpu that
+ * freed them, up to VMAP_CACHE_DEPTH of each size, rather than erased
+ * from vmap_area_root: allocating one again then takes neither
+ * vmap_area_lock nor a search.  Caches are drained when space runs out.
+ */
+#define VMAP_CACHE_PAGES	16	/* largest area cached, in pages */
+#define VMAP_CACHE_DEPTH	4	/* areas cached of each size */
+
+struct vmap_area_cache {
+	spinlock_t lock;		/* protects lazy and free */
+	struct list_head lazy;		/* freed, awaiting the next purge */
+	struct list_head purging;	/* being purged: under purge_lock */
+	struct list_head free[VMAP_CACHE_PAGES];
+	unsigned int nr_free[VMAP_CACHE_PAGES];
+};
+
+static DEFINE_PER_CPU(struct vmap_area_cache, vmap_area_cache);
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -284,11 +306,57 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
+/*
+ * The hole below an area is the free space between it and the area
+ * before it, less one guard page: alloc_vmap_area() does not place an
+ * area right against the end of another.  Each node of vmap_area_root
+ * also records the largest hole in its subtree, so that searches can
+ * skip subtrees in which the requested size cannot fit.
+ */
+static unsigned long vmap_area_hole(struct vmap_area *va,
+				    struct vmap_area *prev)
+{
+	unsigned long start = prev ? prev->va_end + PAGE_SIZE : 0;
+
+	return va->va_start > start ? va->va_start - start : 0;
+}
+
+static unsigned long subtree_max_hole(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct vmap_area, rb_node)->subtree_max_hole
+		    : 0;
+}
+
+static void vmap_area_augment_cb(struct rb_node *node, void *unused)
+{
+	struct vmap_area *va;
+
+	if (!node)
+		return;
+
+	va = rb_entry(node, struct vmap_area, rb_node);
+	va->subtree_max_hole = max3(va->hole, subtree_max_hole(node->rb_left),
+				    subtree_max_hole(node->rb_right));
+}
+
+/* Propagate a change in the hole below this node up to the root */
+static void vmap_area_augment_path(struct rb_node *node)
+{
+	for (; node; node = rb_parent(node))
+		vmap_area_augment_cb(node, NULL);
+}
+
+static struct vmap_area *node_to_va(struct rb_node *n)
+{
+	return n ? rb_entry(n, struct vmap_area, rb_node) : NULL;
+}
+
 static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
 	struct rb_node *parent = NULL;
 	struct rb_node *tmp;
+	struct vmap_area *next;
 
 	while (*p) {
 		struct vmap_area *tmp_va;
@@ -304,10 +372,20 @@ static void __insert_vmap_area(struct vmap_area *va)
 	}
 
 	rb_link_node(&va->rb_node, parent, p);
+	tmp = rb_prev(&va->rb_node);
+	va->hole = vmap_area_hole(va, node_to_va(tmp));
+	va->subtree_max_hole = va->hole;
 	rb_insert_color(&va->rb_node, &vmap_area_root);
+	rb_augment_insert(&va->rb_node, vmap_area_augment_cb, NULL);
+
+	/* va took a piece out of the hole below the next area */
+	next = node_to_va(rb_next(&va->rb_node));
+	if (next) {
+		next->hole = vmap_area_hole(next, va);
+		vmap_area_augment_path(&next->rb_node);
+	}
 
 	/* address-sort this list so it is usable like the vmlist */
-	tmp = rb_prev(&va->rb_node);
 	if (tmp) {
 		struct vmap_area *prev;
 		prev = rb_entry(tmp, struct vmap_area, rb_node);
@@ -316,7 +394,111 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &vmap_area_list);
 }
 
+/*
+ * Does a @size area aligned to @align, at or above @vstart, fit in the
+ * hole below @va?  If so, return its address in *@addr.
+ */
+static bool vmap_hole_fits(struct vmap_area *va, unsigned long size,
+			   unsigned long align, unsigned long vstart,
+			   unsigned long *addr)
+{
+	unsigned long start;
+
+	if (va->hole < size)
+		return false;
+
+	start = ALIGN(max(va->va_start - va->hole, vstart), align);
+	if (start < vstart || start + size < start ||
+	    start + size > va->va_start)
+		return false;
+
+	*addr = start;
+	return true;
+}
+
+/*
+ * Find the lowest address at or above @vstart where a @size area aligned
+ * to @align fits, in the holes below the areas of vmap_area_root or else
+ * above the highest of them.  This is an in-order walk which skips every
+ * subtree whose largest hole is smaller than @size, and everything below
+ * @vstart: so it goes straight down to the answer, unless alignment makes
+ * it back out of some holes which were big enough but badly placed.
+ */
+static bool find_vmap_lowest_hole(unsigned long size, unsigned long align,
+				  unsigned long vstart, unsigned long *addr)
+{
+	struct rb_node *n = vmap_area_root.rb_node;
+	bool descend = true;
+	unsigned long start;
+
+	while (n) {
+		struct vmap_area *va = rb_entry(n, struct vmap_area, rb_node);
+
+		if (descend && n->rb_left && vstart < va->va_start &&
+		    subtree_max_hole(n->rb_left) >= size) {
+			n = n->rb_left;
+			continue;
+		}
+		if (vmap_hole_fits(va, size, align, vstart, addr))
+			return true;
+		if (n->rb_right && subtree_max_hole(n->rb_right) >= size) {
+			n = n->rb_right;
+			descend = true;
+			continue;
+		}
+		/* Done with this subtree: back up to where we went left */
+		while (rb_parent(n) && n == rb_parent(n)->rb_right)
+			n = rb_parent(n);
+		n = rb_parent(n);
+		descend = false;
+	}
+
+	n = rb_last(&vmap_area_root);
+	start = n ? node_to_va(n)->va_end + PAGE_SIZE : 0;
+	start = ALIGN(max(start, vstart), align);
+	if (start < vstart || start + size < start)
+		return false;
+
+	*addr = start;
+	return true;
+}
+
+/*
+ * Take a cached area of exactly @size which suits the constraints from
+ * this cpu's cache.  It is still in vmap_area_root, so that is all.
+ */
+static struct vmap_area *vmap_area_cache_get(unsigned long size,
+				unsigned long align,
+				unsigned long vstart, unsigned long vend)
+{
+	unsigned long nr = size >> PAGE_SHIFT;
+	struct vmap_area_cache *vac;
+	struct vmap_area *va, *found = NULL;
+
+	if (nr > VMAP_CACHE_PAGES)
+		return NULL;
+
+	vac = &get_cpu_var(vmap_area_cache);
+	spin_lock(&vac->lock);
+	list_for_each_entry(va, &vac->free[nr - 1], purge_list) {
+		if (va->va_start >= vstart && va->va_end <= vend &&
+		    IS_ALIGNED(va->va_start, align)) {
+			list_del(&va->purge_list);
+			vac->nr_free[nr - 1]--;
+			found = va;
+			break;
+		}
+	}
+	spin_unlock(&vac->lock);
+	put_cpu_var(vmap_area_cache);
+
+	if (found)
+		found->flags = 0;
+	return found;
+}
+
 static void purge_vmap_area_lazy(void);
+static void drain_vmap_area_caches(void);
 
 /*
  * Allocate a region of KVA of the specified size and alignment, within the
@@ -328,72 +510,29 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
 
+	va = vmap_area_cache_get(size, align, vstart, vend);
+	if (va)
+		return va;
+
 	va = kmalloc_node(sizeof(struct vmap_area),
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
 		return ERR_PTR(-ENOMEM);
 
 retry:
-	addr = ALIGN(vstart, align);
-
 	spin_lock(&vmap_area_lock);
-	if (addr + size - 1 < addr)
-		goto overflow;
-
-	/* XXX: could have a last_hole cache */
-	n = vmap_area_root.rb_node;
-	if (n) {
-		struct vmap_area *first = NULL;
-
-		do {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				if (!first && tmp->va_start < addr + size)
-					first = tmp;
-				n = n->rb_left;
-			} else {
-				first = tmp;
-				n = n->rb_right;
-			}
-		} while (n);
-
-		if (!first)
-			goto found;
-
-		if (first->va_end < addr) {
-			n = rb_next(&first->rb_node);
-			if (n)
-				first = rb_entry(n, struct vmap_area, rb_node);
-			else
-				goto found;
-		}
-
-		while (addr + size > first->va_start && addr + size <= vend) {
-			addr = ALIGN(first->va_end + PAGE_SIZE, align);
-			if (addr + size - 1 < addr)
-				goto overflow;
-
-			n = rb_next(&first->rb_node);
-			if (n)
-				first = rb_entry(n, struct vmap_area, rb_node);
-			else
-				goto found;
-		}
-	}
-found:
-	if (addr + size > vend) {
-overflow:
+	if (!find_vmap_lowest_hole(size, align, vstart, &addr) ||
+	    addr + size > vend) {
 		spin_unlock(&vmap_area_lock);
 		if (!purged) {
 			purge_vmap_area_lazy();
+			drain_vmap_area_caches();
 			purged = 1;
 			goto retry;
 		}
@@ -425,11 +564,24 @@ static void rcu_free_va(struct rcu_head *head)
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_area *prev, *next;
+	struct rb_node *deepest;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
+	prev = node_to_va(rb_prev(&va->rb_node));
+	next = node_to_va(rb_next(&va->rb_node));
+	deepest = rb_augment_erase_begin(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
 
+	/* The hole below the next area now reaches down to prev */
+	if (next) {
+		next->hole = vmap_area_hole(next, prev);
+		vmap_area_augment_path(&next->rb_node);
+	}
+
 	/*
 	 * Track the highest possible candidate for pcpu area
 	 * allocation.  Areas outside of vmalloc area can be returned
@@ -535,9 +687,11 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 {
 	static DEFINE_SPINLOCK(purge_lock);
 	LIST_HEAD(valist);
+	struct vmap_area_cache *vac;
 	struct vmap_area *va;
 	struct vmap_area *n_va;
 	int nr = 0;
+	int cpu;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -553,28 +707,54 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
+	for_each_possible_cpu(cpu) {
+		vac = &per_cpu(vmap_area_cache, cpu);
+		spin_lock(&vac->lock);
+		list_splice_init(&vac->lazy, &vac->purging);
+		spin_unlock(&vac->lock);
+
+		list_for_each_entry(va, &vac->purging, purge_list) {
 			if (va->va_start < *start)
 				*start = va->va_start;
 			if (va->va_end > *end)
 				*end = va->va_end;
 			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
 			va->flags |= VM_LAZY_FREEING;
 			va->flags &= ~VM_LAZY_FREE;
 		}
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
 
+	/*
+	 * One flush for the whole batch, of just the span it covers: the
+	 * architecture may flush that page by page if it is small.
+	 */
 	if (nr || force_flush)
 		flush_tlb_kernel_range(*start, *end);
 
 	if (nr) {
+		/* Now the areas may be reused: keep the small ones at hand */
+		for_each_possible_cpu(cpu) {
+			vac = &per_cpu(vmap_area_cache, cpu);
+			spin_lock(&vac->lock);
+			list_for_each_entry_safe(va, n_va, &vac->purging,
+								purge_list) {
+				unsigned long i;
+
+				i = ((va->va_end - va->va_start) >> PAGE_SHIFT) - 1;
+				if (i < VMAP_CACHE_PAGES &&
+				    vac->nr_free[i] < VMAP_CACHE_DEPTH) {
+					list_move(&va->purge_list,
+						  &vac->free[i]);
+					vac->nr_free[i]++;
+				}
+			}
+			spin_unlock(&vac->lock);
+			list_splice_init(&vac->purging, &valist);
+		}
+
 		spin_lock(&vmap_area_lock);
 		list_for_each_entry_safe(va, n_va, &valist, purge_list)
 			__free_vmap_area(va);
@@ -583,6 +763,37 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	spin_unlock(&purge_lock);
 }
 
+/*
+ * Give back all the purged areas which the cpus have cached, for when
+ * an allocation cannot find space otherwise.
+ */
+static void drain_vmap_area_caches(void)
+{
+	LIST_HEAD(valist);
+	struct vmap_area_cache *vac;
+	struct vmap_area *va;
+	struct vmap_area *n_va;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		vac = &per_cpu(vmap_area_cache, cpu);
+		spin_lock(&vac->lock);
+		for (i = 0; i < VMAP_CACHE_PAGES; i++) {
+			list_splice_init(&vac->free[i], &valist);
+			vac->nr_free[i] = 0;
+		}
+		spin_unlock(&vac->lock);
+	}
+
+	if (list_empty(&valist))
+		return;
+
+	spin_lock(&vmap_area_lock);
+	list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		__free_vmap_area(va);
+	spin_unlock(&vmap_area_lock);
+}
+
 /*
  * Kick off a purge of the outstanding lazy areas. Don't bother if somebody
  * is already purging.
@@ -611,7 +822,15 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	struct vmap_area_cache *vac;
+
 	va->flags |= VM_LAZY_FREE;
+	vac = &get_cpu_var(vmap_area_cache);
+	spin_lock(&vac->lock);
+	list_add_tail(&va->purge_list, &vac->lazy);
+	spin_unlock(&vac->lock);
+	put_cpu_var(vmap_area_cache);
+
 	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
 	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
@@ -1112,10 +1331,19 @@ void __init vmalloc_init(void)
 
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
+		struct vmap_area_cache *vac;
+		int j;
 
 		vbq = &per_cpu(vmap_block_queue, i);
 		spin_lock_init(&vbq->lock);
 		INIT_LIST_HEAD(&vbq->free);
+
+		vac = &per_cpu(vmap_area_cache, i);
+		spin_lock_init(&vac->lock);
+		INIT_LIST_HEAD(&vac->lazy);
+		INIT_LIST_HEAD(&vac->purging);
+		for (j = 0; j < VMAP_CACHE_PAGES; j++)
+			INIT_LIST_HEAD(&vac->free[j]);
 	}
 
 	/* Import existing vmlist entries. */
@@ -2116,11 +2344,6 @@ void free_vm_area(struct vm_struct *area)
 EXPORT_SYMBOL_GPL(free_vm_area);
 
 #ifdef CONFIG_SMP
-static struct vmap_area *node_to_va(struct rb_node *n)
-{
-	return n ? rb_entry(n, struct vmap_area, rb_node) : NULL;
-}
-
 /**
  * pvm_find_next_prev - find the next and prev vmap_area surrounding @end
  * @end: target address
@@ -2304,6 +2527,7 @@ retry:
 			spin_unlock(&vmap_area_lock);
 			if (!purged) {
 				purge_vmap_area_lazy();
+				drain_vmap_area_caches();
 				purged = true;
 				goto retry;
 			}
@@ -871,6 +871,9 @@ static const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
+	"workingset_nodereclaim",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -896,6 +899,10 @@ static const char * const vmstat_text[] = {
 	"pgactivate",
 	"pgdeactivate",
 
+	"pcp_highorder_alloc",
+	"pcp_highorder_refill",
+	"pcp_highorder_free",
+
 	"pgfault",
 	"pgmajfault",
 
@@ -918,6 +925,14 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"pglazyfree",
+	"pglazyfreed",
+	"readahead_hit",
+	"readahead_miss",
+	"readahead_pages",
+	"readahead_wasted",
+	"readahead_stride",
+	"readahead_backward",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -926,6 +941,29 @@ static const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_time_ms",
+	"compact_daemon_wake",
+	"compact_daemon_migrated",
+	"compact_daemon_time_ms",
+#endif
+
+#ifdef CONFIG_NUMA_BALANCING
+	"numa_pte_updates",
+	"numa_hint_faults",
+	"numa_hint_faults_local",
+	"numa_pages_migrated",
+#endif
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_abort",
+#endif
+
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	"nr_tlb_remote_flush",
+	"nr_tlb_remote_flush_received",
+	"nr_tlb_local_flush_all",
+	"nr_tlb_local_flush_one",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -0,0 +1,302 @@
+/*
+ * Workingset detection
+ *
+ * Detect page cache thrashing from the distance between the eviction
+ * of a page and its refault.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/radix-tree.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/spinlock.h>
+
+/*
+ *		Double CLOCK lists
+ *
+ * Per zone, two clock lists are maintained for file pages: the
+ * inactive and the active list.  Freshly faulted pages start out at
+ * the head of the inactive list and page reclaim scans pages from the
+ * tail.  Pages that are accessed multiple times on the inactive list
+ * are promoted to the active list, to protect them from reclaim,
+ * whereas active pages are demoted to the inactive list when the
+ * active list grows too big.
+ *
+ * A workload is thrashing when its pages are frequently used but they
+ * are evicted from the inactive list every time before another access
+ * would have promoted them to the active list.  A streaming read never
+ * accesses its pages twice, so the only thing rotation heuristics see
+ * of such a working set is that it keeps getting read in.
+ *
+ *		Approximating inactive page access frequency
+ *
+ * Consider the zone's inactive_age: a counter that is incremented on
+ * every eviction from the inactive list and on every activation.  The
+ * difference between its value when a page was evicted and when it is
+ * faulted back in again -- the refault distance -- is the minimum
+ * number of slots the inactive list would have needed on top of its
+ * current size to have kept the page in memory until its second
+ * access.
+ *
+ * All that is needed is to remember the counter at eviction time.  The
+ * page cache does that by leaving a shadow entry, which packs the
+ * counter and the zone, in the radix tree slot of the evicted page.
+ *
+ *		Activating refaulting pages
+ *
+ * If the refault distance is less than the size of the active list,
+ * the inactive list could have held on to the page for long enough if
+ * it had that much more space, at the expense of the active pages.
+ * The refaulting page is then activated straight away: it either gets
+ * to stay in memory this time or it competes with the active pages on
+ * equal terms, and the active list shrinks if they are no longer used.
+ * Refaults with a longer distance are regular cache misses and start
+ * out on the inactive list like any other new page.
+ *
+ *		Reclaiming shadow entries
+ *
+ * Shadow entries keep the radix tree nodes they sit in alive for as
+ * long as the inode is cached, which for open files can be forever.
+ * Nodes that hold only shadow entries are therefore put on a list,
+ * and a shrinker frees them when they take up more memory than the
+ * shadows in them could possibly be worth: see count_shadow_nodes().
+ */
+
+/*
+ * Bits of the shadow entry, from the bottom: the radix tree's exceptional
+ * bits, the zone index, the node id and the eviction counter.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+
+	/*
+	 * The counter may have wrapped since the eviction.  Only the
+	 * bits that fit in the shadow entry are compared, which is
+	 * fine as long as no more than EVICTION_MASK pages were
+	 * evicted and activated in between; after that the distance
+	 * is meaningless anyway.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Radix tree nodes that contain only shadow entries, oldest first.
+ * Nested inside the tree_lock of the node's mapping.
+ */
+static LIST_HEAD(shadow_nodes);
+static DEFINE_SPINLOCK(shadow_nodes_lock);
+static unsigned long nr_shadow_nodes;
+
+/**
+ * workingset_remember_node - track a node that holds only shadow entries
+ * @mapping: address space the node belongs to
+ * @index: index of any slot in @node
+ * @node: leaf node of @mapping->page_tree without pages
+ *
+ * The caller must hold @mapping->tree_lock, which also protects the
+ * node's list membership against the shrinker.
+ */
+void workingset_remember_node(struct address_space *mapping,
+			      unsigned long index,
+			      struct radix_tree_node *node)
+{
+	if (!list_empty(&node->private_list))
+		return;
+
+	node->private_data = mapping;
+	node->private_index = index;
+	spin_lock(&shadow_nodes_lock);
+	list_add_tail(&node->private_list, &shadow_nodes);
+	nr_shadow_nodes++;
+	spin_unlock(&shadow_nodes_lock);
+}
+
+/**
+ * workingset_forget_node - stop tracking a node
+ * @node: leaf node that got a page inserted or is about to be freed
+ *
+ * The caller must hold the tree_lock of the node's mapping.
+ */
+void workingset_forget_node(struct radix_tree_node *node)
+{
+	if (list_empty(&node->private_list))
+		return;
+
+	spin_lock(&shadow_nodes_lock);
+	list_del_init(&node->private_list);
+	nr_shadow_nodes--;
+	spin_unlock(&shadow_nodes_lock);
+}
+
+static unsigned long count_shadow_nodes(void)
+{
+	unsigned long max_nodes;
+
+	/*
+	 * Active cache pages are limited to 50% of memory, and shadow
+	 * entries that represent a refault distance bigger than that
+	 * do not have any effect.  Limit the number of shadow nodes
+	 * such that shadow entries do not exceed the number of active
+	 * cache pages, assuming a worst-case node population density
+	 * of 1/8th on average.
+	 *
+	 * With 64 slots per node, this reclaims shadow entries when
+	 * their nodes take up more than ~2% of memory.
+	 */
+	max_nodes = totalram_pages >> (1 + RADIX_TREE_MAP_SHIFT - 3);
+	if (nr_shadow_nodes <= max_nodes)
+		return 0;
+	return nr_shadow_nodes - max_nodes;
+}
+
+static void reclaim_shadow_node(struct address_space *mapping,
+				struct radix_tree_node *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
+		if (!node->slots[i])
+			continue;
+		BUG_ON(!radix_tree_exceptional_entry(node->slots[i]));
+		node->slots[i] = NULL;
+		workingset_node_shadows_dec(node);
+		BUG_ON(!mapping->nrshadows);
+		mapping->nrshadows--;
+	}
+	BUG_ON(node->count);
+	inc_zone_state(page_zone(virt_to_page(node)), WORKINGSET_NODERECLAIM);
+	if (!__radix_tree_delete_node(&mapping->page_tree,
+				      node->private_index, node))
+		BUG();
+}
+
+static int shrink_shadow_nodes(struct shrinker *shrink, int nr_to_scan,
+			       gfp_t gfp_mask)
+{
+	struct address_space *mapping;
+	struct radix_tree_node *node;
+
+	if (!nr_to_scan)
+		return count_shadow_nodes();
+
+	spin_lock_irq(&shadow_nodes_lock);
+	while (nr_to_scan-- && count_shadow_nodes()) {
+		node = list_first_entry(&shadow_nodes, struct radix_tree_node,
+					private_list);
+		/*
+		 * The mapping can't go away while the node is on the
+		 * list: the final truncate takes shadow_nodes_lock to
+		 * take the node off.  But the lock order is inverted
+		 * here, so only trylock the tree_lock.
+		 */
+		mapping = node->private_data;
+		if (!spin_trylock(&mapping->tree_lock)) {
+			list_move_tail(&node->private_list, &shadow_nodes);
+			continue;
+		}
+		list_del_init(&node->private_list);
+		nr_shadow_nodes--;
+		spin_unlock(&shadow_nodes_lock);
+
+		reclaim_shadow_node(mapping, node);
+
+		spin_unlock(&mapping->tree_lock);
+		spin_lock(&shadow_nodes_lock);
+	}
+	spin_unlock_irq(&shadow_nodes_lock);
+
+	return count_shadow_nodes();
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadow_nodes,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
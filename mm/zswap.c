@@ -0,0 +1,571 @@
+/*
+ * zswap - compressed cache for swap pages
+ *
+ * Anonymous pages on their way to the swap device are compressed with LZO
+ * and kept in RAM instead.  A later swap-in of such a page is satisfied by
+ * decompressing it, which costs microseconds rather than the milliseconds
+ * of a device read.
+ *
+ * Every swap area has its own tree of compressed entries, indexed by swap
+ * offset, and an LRU list of those entries.  The pool is capped at
+ * max_pool_percent of RAM: once it is full, the coldest entries are
+ * decompressed back into the swap cache and written to the real device
+ * to make room.
+ *
+ * Locking: each tree has a spinlock protecting its rbtree, its LRU list
+ * and the refcounts of its entries.  The tree holds one reference on an
+ * entry for as long as the entry is linked in; writeback takes another
+ * while it works without the lock, so that a concurrent invalidation
+ * cannot free the entry underneath it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/writeback.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/lzo.h>
+#include <linux/debugfs.h>
+#include <linux/zswap.h>
+
+/*
+ * Tunables
+ */
+static int zswap_enabled = 1;
+module_param_named(enabled, zswap_enabled, bool, 0644);
+
+/* The pool may use at most this percentage of RAM */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* Entries written back per store that finds the pool full */
+#define ZSWAP_WRITEBACK_BATCH	16
+
+/*
+ * Statistics
+ */
+static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+static atomic_long_t zswap_pool_bytes = ATOMIC_LONG_INIT(0);
+
+/*
+ * The following counters are only informational and are updated without
+ * any serialization, so they may be off by a little.
+ */
+static u64 zswap_pool_limit_hit;
+static u64 zswap_written_back_pages;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_reject_writeback_fail;
+static u64 zswap_duplicate_entry;
+static u64 zswap_loaded_pages;
+
+/*
+ * Data structures
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	struct list_head lru;
+	pgoff_t offset;
+	int refcount;			/* protected by tree->lock */
+	unsigned int length;
+	void *data;
+};
+
+struct zswap_tree {
+	struct rb_root rbroot;
+	struct list_head lru;		/* most recently stored at the head */
+	spinlock_t lock;
+};
+
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+static struct kmem_cache *zswap_entry_cache;
+
+static DEFINE_PER_CPU(void *, zswap_wrkmem);
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+
+static int zswap_is_full(void)
+{
+	unsigned long pool_pages;
+
+	pool_pages = DIV_ROUND_UP(atomic_long_read(&zswap_pool_bytes),
+				  PAGE_SIZE);
+	return pool_pages > totalram_pages * zswap_max_pool_percent / 100;
+}
+
+/*
+ * Tree and entry management
+ */
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (offset < entry->offset)
+			node = node->rb_left;
+		else if (offset > entry->offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/* The caller has made sure that no entry for this offset is present */
+static void zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *this;
+
+	while (*link) {
+		parent = *link;
+		this = rb_entry(parent, struct zswap_entry, rbnode);
+		if (entry->offset < this->offset)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+}
+
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	atomic_long_sub(ksize(entry->data), &zswap_pool_bytes);
+	atomic_dec(&zswap_stored_pages);
+	kfree(entry->data);
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+static void zswap_entry_put(struct zswap_entry *entry)
+{
+	if (--entry->refcount == 0)
+		zswap_free_entry(entry);
+}
+
+/* Unlink an entry from its tree and drop the tree's reference */
+static void zswap_erase_entry(struct zswap_tree *tree,
+			      struct zswap_entry *entry)
+{
+	rb_erase(&entry->rbnode, &tree->rbroot);
+	RB_CLEAR_NODE(&entry->rbnode);
+	list_del_init(&entry->lru);
+	zswap_entry_put(entry);
+}
+
+/*
+ * Writeback
+ */
+
+/*
+ * Push the data of one entry out to the swap device.  The page is brought
+ * into the swap cache through the normal swapin path, which decompresses
+ * it from this very entry, and is then written with __swap_writepage() so
+ * that it does not come straight back to us.
+ *
+ * Returns 0 if the write was started, in which case the caller may drop
+ * the entry.
+ */
+static int zswap_writeback_entry(unsigned type, pgoff_t offset)
+{
+	swp_entry_t swpentry = swp_entry(type, offset);
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+	struct page *page;
+	int ret = -EBUSY;
+
+	page = read_swap_cache_async(swpentry, GFP_NOIO | __GFP_NOWARN,
+				     NULL, 0);
+	if (!page)
+		return -ENOMEM;
+
+	/*
+	 * The page may have been in the swap cache already, and may even be
+	 * the one our caller is storing right now: never wait on it.
+	 */
+	if (!trylock_page(page))
+		goto out;
+
+	/*
+	 * Only a clean, unmapped swap cache page is guaranteed to hold the
+	 * same data as the entry; anything else is left for reclaim.
+	 */
+	if (!PageSwapCache(page) || page_private(page) != swpentry.val ||
+	    !PageUptodate(page) || PageDirty(page) || PageWriteback(page) ||
+	    page_mapped(page)) {
+		unlock_page(page);
+		goto out;
+	}
+
+	/* Reclaim will find the page right after the write completes */
+	SetPageReclaim(page);
+	ret = __swap_writepage(page, &wbc);
+	if (!ret)
+		zswap_written_back_pages++;
+out:
+	page_cache_release(page);
+	return ret;
+}
+
+/*
+ * Write back up to @nr of the least recently stored entries of a tree.
+ * Returns the number of entries which were written back.
+ */
+static int zswap_writeback_entries(unsigned type, int nr)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	pgoff_t offset;
+	int done = 0;
+	int ret;
+
+	while (nr--) {
+		spin_lock(&tree->lock);
+		if (list_empty(&tree->lru)) {
+			spin_unlock(&tree->lock);
+			break;
+		}
+		entry = list_entry(tree->lru.prev, struct zswap_entry, lru);
+		list_del_init(&entry->lru);
+		entry->refcount++;
+		offset = entry->offset;
+		spin_unlock(&tree->lock);
+
+		ret = zswap_writeback_entry(type, offset);
+
+		spin_lock(&tree->lock);
+		if (!RB_EMPTY_NODE(&entry->rbnode)) {
+			if (!ret)
+				zswap_erase_entry(tree, entry);
+			else
+				/* Busy: give it another trip round the LRU */
+				list_add(&entry->lru, &tree->lru);
+		}
+		zswap_entry_put(entry);
+		spin_unlock(&tree->lock);
+
+		if (ret)
+			zswap_reject_writeback_fail++;
+		else
+			done++;
+	}
+	return done;
+}
+
+/*
+ * Frontend
+ */
+
+/**
+ * zswap_store - compress a swap cache page into the pool
+ * @page: locked swap cache page about to be written to the swap device
+ *
+ * Returns 0 if the page is now held by zswap and need not be written to
+ * the device, or a negative errno if it must take the normal path.
+ */
+int zswap_store(struct page *page)
+{
+	swp_entry_t swpentry = { .val = page_private(page) };
+	unsigned type = swp_type(swpentry);
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	size_t dlen;
+	u8 *src, *dst;
+	void *data;
+	int ret;
+
+	if (!zswap_enabled || !tree)
+		return -ENODEV;
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		zswap_writeback_entries(type, ZSWAP_WRITEBACK_BATCH);
+		if (zswap_is_full())
+			return -ENOMEM;
+	}
+
+	entry = kmem_cache_alloc(zswap_entry_cache, GFP_NOIO | __GFP_NOWARN);
+	if (!entry) {
+		zswap_reject_alloc_fail++;
+		return -ENOMEM;
+	}
+
+	/* Compress into the per-cpu buffer */
+	dst = get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen,
+			       __get_cpu_var(zswap_wrkmem));
+	kunmap_atomic(src, KM_USER0);
+
+	/*
+	 * kmalloc rounds anything above half a page up to a whole page,
+	 * so keeping such a page would save nothing.
+	 */
+	if (ret != LZO_E_OK || dlen > PAGE_SIZE / 2) {
+		put_cpu_var(zswap_dstmem);
+		zswap_reject_compress_poor++;
+		ret = -EINVAL;
+		goto free_entry;
+	}
+
+	data = kmalloc(dlen, GFP_NOWAIT | __GFP_NOWARN);
+	if (!data) {
+		put_cpu_var(zswap_dstmem);
+		zswap_reject_alloc_fail++;
+		ret = -ENOMEM;
+		goto free_entry;
+	}
+	memcpy(data, dst, dlen);
+	put_cpu_var(zswap_dstmem);
+
+	entry->offset = swp_offset(swpentry);
+	entry->refcount = 1;
+	entry->length = dlen;
+	entry->data = data;
+	INIT_LIST_HEAD(&entry->lru);
+	atomic_inc(&zswap_stored_pages);
+	atomic_long_add(ksize(data), &zswap_pool_bytes);
+
+	spin_lock(&tree->lock);
+	dupentry = zswap_rb_search(&tree->rbroot, entry->offset);
+	if (dupentry) {
+		/* The page was redirtied and is being swapped out again */
+		zswap_duplicate_entry++;
+		zswap_erase_entry(tree, dupentry);
+	}
+	zswap_rb_insert(&tree->rbroot, entry);
+	list_add(&entry->lru, &tree->lru);
+	spin_unlock(&tree->lock);
+
+	return 0;
+
+free_entry:
+	kmem_cache_free(zswap_entry_cache, entry);
+	return ret;
+}
+
+/**
+ * zswap_load - fill a swap cache page from the pool
+ * @page: locked, not uptodate swap cache page being read in
+ *
+ * Returns 0 if the page was filled, or a negative errno if zswap does not
+ * hold it and it must be read from the device.
+ *
+ * The entry stays in the pool: the swap cache page is clean and may be
+ * dropped again without a write, relying on zswap to still have its data.
+ */
+int zswap_load(struct page *page)
+{
+	swp_entry_t swpentry = { .val = page_private(page) };
+	struct zswap_tree *tree = zswap_trees[swp_type(swpentry)];
+	struct zswap_entry *entry;
+	size_t dlen = PAGE_SIZE;
+	u8 *dst;
+	int ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, swp_offset(swpentry));
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	spin_unlock(&tree->lock);
+
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+	zswap_loaded_pages++;
+	return 0;
+}
+
+/**
+ * zswap_invalidate_page - drop the pool's copy of a freed swap slot
+ * @type: swap area
+ * @offset: slot within the area
+ *
+ * Called with swap_lock held once the last reference to the slot is gone.
+ */
+void zswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry)
+		zswap_erase_entry(tree, entry);
+	spin_unlock(&tree->lock);
+}
+
+/**
+ * zswap_init_area - set up the pool's tree for a new swap area
+ * @type: swap area being enabled
+ *
+ * zswap simply stays out of the way of an area whose tree could not be
+ * allocated.
+ */
+void zswap_init_area(unsigned type)
+{
+	struct zswap_tree *tree;
+
+	if (!zswap_entry_cache)
+		return;
+
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree) {
+		printk(KERN_WARNING "zswap: no memory for swap area %u\n",
+		       type);
+		return;
+	}
+	tree->rbroot = RB_ROOT;
+	INIT_LIST_HEAD(&tree->lru);
+	spin_lock_init(&tree->lock);
+	zswap_trees[type] = tree;
+}
+
+/**
+ * zswap_invalidate_area - tear down the tree of a swap area
+ * @type: swap area being disabled
+ *
+ * By the time swapoff gets here every slot has been freed, so the tree
+ * is normally empty already.
+ */
+void zswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot))) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		zswap_erase_entry(tree, entry);
+	}
+	spin_unlock(&tree->lock);
+
+	zswap_trees[type] = NULL;
+	kfree(tree);
+}
+
+/*
+ * debugfs
+ */
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zswap_debugfs_root;
+
+static int zswap_pool_total_size_get(void *data, u64 *val)
+{
+	*val = atomic_long_read(&zswap_pool_bytes);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_pool_total_size_fops,
+			zswap_pool_total_size_get, NULL, "%llu\n");
+
+static int __init zswap_debugfs_init(void)
+{
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			   zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("written_back_pages", S_IRUGO,
+			   zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("reject_writeback_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_writeback_fail);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			   zswap_debugfs_root, &zswap_duplicate_entry);
+	debugfs_create_u64("loaded_pages", S_IRUGO,
+			   zswap_debugfs_root, &zswap_loaded_pages);
+	debugfs_create_u32("stored_pages", S_IRUGO,
+			   zswap_debugfs_root, (u32 *)&zswap_stored_pages);
+	debugfs_create_file("pool_total_size", S_IRUGO,
+			    zswap_debugfs_root, NULL,
+			    &zswap_pool_total_size_fops);
+	return 0;
+}
+#else
+static inline int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Initialization
+ */
+static int __init zswap_cpu_buffers_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		void *wrkmem;
+		u8 *dst;
+
+		wrkmem = kmalloc_node(LZO1X_MEM_COMPRESS, GFP_KERNEL,
+				      cpu_to_node(cpu));
+		dst = kmalloc_node(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL,
+				   cpu_to_node(cpu));
+		per_cpu(zswap_wrkmem, cpu) = wrkmem;
+		per_cpu(zswap_dstmem, cpu) = dst;
+		if (!wrkmem || !dst)
+			goto fail;
+	}
+	return 0;
+
+fail:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zswap_wrkmem, cpu));
+		kfree(per_cpu(zswap_dstmem, cpu));
+		per_cpu(zswap_wrkmem, cpu) = NULL;
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+	return -ENOMEM;
+}
+
+static int __init zswap_init(void)
+{
+	if (zswap_cpu_buffers_init()) {
+		printk(KERN_ERR "zswap: per-cpu buffer allocation failed\n");
+		return -ENOMEM;
+	}
+
+	/* Swap areas enabled from now on get a tree */
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache) {
+		printk(KERN_ERR "zswap: entry cache creation failed\n");
+		return -ENOMEM;
+	}
+
+	zswap_debugfs_init();
+	printk(KERN_INFO "zswap: using lzo compression, pool limit %u%%\n",
+	       zswap_max_pool_percent);
+	return 0;
+}
+/* Must be ready before userspace can run swapon */
+subsys_initcall(zswap_init);
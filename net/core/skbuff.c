@@ -55,6 +55,7 @@
 #include <linux/cache.h>
 #include <linux/rtnetlink.h>
 #include <linux/init.h>
+#include <linux/cpu.h>
 #include <linux/scatterlist.h>
 #include <linux/errqueue.h>
 
@@ -152,6 +153,37 @@ static void skb_under_panic(struct sk_buff *skb, int sz, void *here)
  *
  */
 
+/*
+ * sk_buff heads for allocations from softirq context, like the RX ring
+ * refill in NAPI poll, come from a per cpu cache that is refilled in
+ * bulk.  Softirqs don't nest, so the cache needs no locking.
+ */
+#define SKB_BULK	16
+
+struct skb_head_cache {
+	unsigned int	count;
+	void		*heads[SKB_BULK];
+};
+static DEFINE_PER_CPU(struct skb_head_cache, skb_head_cache);
+
+static struct sk_buff *skb_head_cache_get(gfp_t gfp_mask)
+{
+	struct skb_head_cache *hc;
+
+	/* Bulk allocation needs interrupts enabled */
+	if (!in_serving_softirq() || in_irq() || irqs_disabled())
+		return NULL;
+
+	hc = &__get_cpu_var(skb_head_cache);
+	if (unlikely(!hc->count)) {
+		hc->count = kmem_cache_alloc_bulk(skbuff_head_cache, gfp_mask,
+						  SKB_BULK, hc->heads);
+		if (unlikely(!hc->count))
+			return NULL;
+	}
+	return hc->heads[--hc->count];
+}
+
 /**
  *	__alloc_skb	-	allocate a network buffer
  *	@size: size to allocate
@@ -178,7 +210,11 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 	cache = fclone ? skbuff_fclone_cache : skbuff_head_cache;
 
 	/* Get the HEAD */
-	skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
+	skb = NULL;
+	if (!fclone && node == NUMA_NO_NODE)
+		skb = skb_head_cache_get(gfp_mask & ~__GFP_DMA);
+	if (!skb)
+		skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
 	if (!skb)
 		goto out;
 	prefetchw(skb);
@@ -291,17 +327,44 @@ struct sk_buff *dev_alloc_skb(unsigned int length)
 }
 EXPORT_SYMBOL(dev_alloc_skb);
 
+static void kfree_skbmem(struct sk_buff *skb);
+static void skb_release_all(struct sk_buff *skb);
+
+/*
+ * Frag lists of GRO'ed or reassembled packets can be long. Release the
+ * segments one by one but hand the sk_buff heads back to the slab in
+ * batches.
+ */
 static void skb_drop_list(struct sk_buff **listp)
 {
 	struct sk_buff *list = *listp;
+	void *heads[SKB_BULK];
+	int nr = 0;
 
 	*listp = NULL;
 
 	do {
 		struct sk_buff *this = list;
 		list = list->next;
-		kfree_skb(this);
+
+		if (!skb_unref(this))
+			continue;
+		trace_kfree_skb(this, __builtin_return_address(0));
+
+		skb_release_all(this);
+		if (this->fclone != SKB_FCLONE_UNAVAILABLE) {
+			kfree_skbmem(this);
+			continue;
+		}
+		heads[nr++] = this;
+		if (nr == SKB_BULK) {
+			kmem_cache_free_bulk(skbuff_head_cache, nr, heads);
+			nr = 0;
+		}
 	} while (list);
+
+	if (nr)
+		kmem_cache_free_bulk(skbuff_head_cache, nr, heads);
 }
 
 static inline void skb_drop_fraglist(struct sk_buff *skb)
@@ -431,9 +494,7 @@ void kfree_skb(struct sk_buff *skb)
 {
 	if (unlikely(!skb))
 		return;
-	if (likely(atomic_read(&skb->users) == 1))
-		smp_rmb();
-	else if (likely(!atomic_dec_and_test(&skb->users)))
+	if (!skb_unref(skb))
 		return;
 	trace_kfree_skb(skb, __builtin_return_address(0));
 	__kfree_skb(skb);
@@ -452,9 +513,7 @@ void consume_skb(struct sk_buff *skb)
 {
 	if (unlikely(!skb))
 		return;
-	if (likely(atomic_read(&skb->users) == 1))
-		smp_rmb();
-	else if (likely(!atomic_dec_and_test(&skb->users)))
+	if (!skb_unref(skb))
 		return;
 	trace_consume_skb(skb);
 	__kfree_skb(skb);
@@ -2771,6 +2830,22 @@ done:
 }
 EXPORT_SYMBOL_GPL(skb_gro_receive);
 
+static int skb_cpu_callback(struct notifier_block *nfb,
+			    unsigned long action, void *hcpu)
+{
+	struct skb_head_cache *hc;
+
+	if (action != CPU_DEAD && action != CPU_DEAD_FROZEN)
+		return NOTIFY_OK;
+
+	/* Give the cached heads of the offline CPU back to the slab */
+	hc = &per_cpu(skb_head_cache, (unsigned long)hcpu);
+	kmem_cache_free_bulk(skbuff_head_cache, hc->count, hc->heads);
+	hc->count = 0;
+
+	return NOTIFY_OK;
+}
+
 void __init skb_init(void)
 {
 	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
@@ -2784,6 +2859,7 @@ void __init skb_init(void)
 						0,
 						SLAB_HWCACHE_ALIGN|SLAB_PANIC,
 						NULL);
+	hotcpu_notifier(skb_cpu_callback, 0);
 }
 
 /**